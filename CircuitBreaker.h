@@ -0,0 +1,228 @@
+#ifndef XG_CIRCUITBREAKER_H
+#define XG_CIRCUITBREAKER_H
+//////////////////////////////////////////////////////////////////////////////
+#include "typedef.h"
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+// 熔断器：连续失败达到阈值后断开(OPEN)，期间调用方立即失败；由一个后台线程按指数退避探测，
+// 探测成功后进入半开(HALFOPEN)状态放行一次试探，试探成功则恢复(CLOSED)，失败则重新断开
+class CircuitBreaker
+{
+public:
+	static const int CLOSED = 0;
+	static const int OPEN = 1;
+	static const int HALFOPEN = 2;
+
+	struct Stat
+	{
+		int state;	// 当前状态
+		int backoff;	// 下一次探测的等待时间(毫秒)
+		int threshold;	// 断开需要的连续失败次数
+		int mindelay;	// 最短探测间隔(毫秒)
+		int maxdelay;	// 最长探测间隔(毫秒)
+		int64 openCount;	// 断开的次数
+		int64 probeCount;	// 探测的次数
+		int64 failCount;	// 记录的失败次数
+		int64 rejectCount;	// 断开期间被拒绝的请求数
+	};
+
+protected:
+	mutex mtx;
+	bool stop = false;
+	bool trial = false;	// 半开状态下是否已放行试探请求
+	int threshold;
+	int mindelay;
+	int maxdelay;
+	int backoff;
+	thread prober;
+	atomic<int> state;
+	atomic<int> failures;	// 连续失败次数
+	atomic<int64> openCount;
+	atomic<int64> probeCount;
+	atomic<int64> failCount;
+	atomic<int64> rejectCount;
+	condition_variable cv;
+	function<bool()> probe;
+
+	// 调用时已持有锁
+	void open()
+	{
+		state = OPEN;
+		trial = false;
+		openCount++;
+
+		if (prober.joinable() == false) prober = thread(&CircuitBreaker::run, this);
+
+		cv.notify_all();
+	}
+	void run()
+	{
+		unique_lock<mutex> lk(mtx);
+
+		while (stop == false)
+		{
+			if (state != OPEN)
+			{
+				cv.wait(lk, [&]() {
+					return stop || state == OPEN;
+				});
+
+				continue;
+			}
+
+			int delay = backoff;
+
+			if (cv.wait_for(lk, chrono::milliseconds(delay), [&]() { return stop; })) break;
+
+			lk.unlock();
+
+			bool res = probe ? probe() : true;
+
+			lk.lock();
+
+			probeCount++;
+
+			if (state != OPEN) continue;
+
+			if (res)
+			{
+				state = HALFOPEN;
+				trial = false;
+			}
+			else
+			{
+				backoff = min(maxdelay, backoff * 2);
+			}
+		}
+	}
+
+public:
+	// 是否允许发起请求：断开时拒绝，半开时只放行一个试探请求，其结果必须通过success或failure报告
+	bool allow()
+	{
+		int val = state;
+
+		if (val == CLOSED) return true;
+
+		if (val == HALFOPEN)
+		{
+			lock_guard<mutex> lk(mtx);
+
+			if (state == CLOSED) return true;
+
+			if (state == HALFOPEN && trial == false) return trial = true;
+		}
+
+		rejectCount++;
+
+		return false;
+	}
+	// 是否处于断开状态，断开时计入被拒绝的请求数
+	bool isOpen()
+	{
+		if (state != OPEN) return false;
+
+		rejectCount++;
+
+		return true;
+	}
+	void success()
+	{
+		if (state == CLOSED && failures == 0) return;
+
+		lock_guard<mutex> lk(mtx);
+
+		failures = 0;
+
+		if (state == HALFOPEN)
+		{
+			state = CLOSED;
+			backoff = mindelay;
+		}
+	}
+	void failure()
+	{
+		lock_guard<mutex> lk(mtx);
+
+		failCount++;
+
+		if (state == HALFOPEN)
+		{
+			open();
+		}
+		else if (state == CLOSED && ++failures >= threshold)
+		{
+			failures = 0;
+			backoff = mindelay;
+
+			open();
+		}
+	}
+	int getState() const
+	{
+		return state;
+	}
+	Stat getStat()
+	{
+		Stat stat;
+		lock_guard<mutex> lk(mtx);
+
+		stat.state = state;
+		stat.backoff = backoff;
+		stat.threshold = threshold;
+		stat.mindelay = mindelay;
+		stat.maxdelay = maxdelay;
+		stat.openCount = openCount;
+		stat.probeCount = probeCount;
+		stat.failCount = failCount;
+		stat.rejectCount = rejectCount;
+
+		return stat;
+	}
+	// 探测函数在后台线程中调用，返回true表示服务已经恢复
+	void setProbe(function<bool()> probe)
+	{
+		lock_guard<mutex> lk(mtx);
+
+		this->probe = probe;
+	}
+	// 连续失败threshold次后断开，探测间隔从mindelay毫秒开始逐次翻倍，最长maxdelay毫秒
+	void setThreshold(int threshold, int mindelay = 100, int maxdelay = 5000)
+	{
+		lock_guard<mutex> lk(mtx);
+
+		this->threshold = max(1, threshold);
+		this->mindelay = max(1, mindelay);
+		this->maxdelay = max(this->mindelay, maxdelay);
+		this->backoff = this->mindelay;
+	}
+	CircuitBreaker(function<bool()> probe = NULL, int threshold = 3, int mindelay = 100, int maxdelay = 5000) : probe(probe)
+	{
+		state = CLOSED;
+		failures = 0;
+		openCount = probeCount = failCount = rejectCount = 0;
+
+		setThreshold(threshold, mindelay, maxdelay);
+	}
+	~CircuitBreaker()
+	{
+		{
+			lock_guard<mutex> lk(mtx);
+
+			stop = true;
+			cv.notify_all();
+		}
+
+		if (prober.joinable()) prober.join();
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,266 @@
+#ifndef XG_REDISCAPTURE_H
+#define XG_REDISCAPTURE_H
+//////////////////////////////////////////////////////////////////////////////
+#include "typedef.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+// 请求流量录制：开启后Socket发送的每一段请求数据连同时间戳和连接编号追加写入文件，
+// 由命令行工具的replay模式按原始节奏(或加速)回放。未开启时每次发送只多一次原子变量读取。
+// 连接编号按每次建立连接分配(重连后是新的连接)，AUTH、HELLO的参数在写入文件前替换为'*'，不会记录密码。
+// 文件格式：头部"RCAP"加版本号，之后每条记录依次为距上一条记录的微秒数、连接编号、数据长度(均为变长整数)和数据
+class RedisCapture
+{
+public:
+	static const u_int64 FRAME_MAXLEN = 512 * 1024 * 1024;	// 单条记录的长度上限，超过时视为文件损坏
+
+	struct Frame
+	{
+		int conn;	// 连接编号，同一连接上的数据按顺序回放
+		int64 time;	// 距录制开始的微秒数
+		string data;	// 发送的原始请求数据(可能包含多条或半条命令)
+	};
+
+protected:
+	mutex mtx;
+	FILE* fp = NULL;
+	int64 last = 0;
+	atomic<bool> active;
+	unordered_map<u_int64, int> conns;	// 连接序号到文件中连接编号的映射
+
+	static RedisCapture& GetWriter()
+	{
+		static RedisCapture writer;
+		return writer;
+	}
+	void putVarint(u_int64 val)
+	{
+		u_char buf[10];
+		int len = 0;
+
+		while (val >= 0x80)
+		{
+			buf[len++] = (u_char)(val | 0x80);
+			val >>= 7;
+		}
+
+		buf[len++] = (u_char)(val);
+
+		fwrite(buf, 1, len, fp);
+	}
+	bool getVarint(u_int64& val)
+	{
+		int ch;
+		int shift = 0;
+
+		val = 0;
+
+		while ((ch = fgetc(fp)) != EOF && shift < 64)
+		{
+			val |= (u_int64)(ch & 0x7F) << shift;
+
+			if ((ch & 0x80) == 0) return true;
+
+			shift += 7;
+		}
+
+		return false;
+	}
+
+	// 读取data中pos处的一个RESP长度前缀(如"*3\r\n"或"$5\r\n")，数据不完整或格式错误返回false
+	static bool GetLength(const char* data, size_t len, size_t& pos, char tag, size_t& val)
+	{
+		if (pos >= len || data[pos] != tag) return false;
+
+		const char* end = (const char*)(memchr(data + pos, '\n', len - pos));
+
+		if (end == NULL) return false;
+
+		val = strtoul(data + pos + 1, NULL, 10);
+		pos = end - data + 1;
+
+		return true;
+	}
+	// 把data中AUTH、HELLO命令的参数替换为等长的'*'，没有需要隐藏的内容时返回false。
+	// 只处理从数据开头起完整的命令，不完整的部分原样保留
+	static bool Redact(const char* data, size_t len, string& out)
+	{
+		size_t pos = 0;
+		size_t num = 0;
+		size_t size = 0;
+
+		while (GetLength(data, len, pos, '*', num) && num > 0)
+		{
+			if (GetLength(data, len, pos, '$', size) == false || pos + size + 2 > len) break;
+
+			string name(data + pos, size);
+
+			for (char& ch : name) ch = tolower(ch);
+
+			bool secret = name == "auth" || name == "hello";
+
+			pos += size + 2;
+
+			for (size_t i = 1; i < num; i++)
+			{
+				if (GetLength(data, len, pos, '$', size) == false || pos + size + 2 > len) return out.size() > 0;
+
+				if (secret)
+				{
+					if (out.empty()) out.assign(data, len);
+
+					memset(&out[pos], '*', size);
+				}
+
+				pos += size + 2;
+			}
+		}
+
+		return out.size() > 0;
+	}
+
+public:
+	static int64 GetClock()
+	{
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	// 开始录制到文件(覆盖已有文件)，正在录制时先结束之前的录制
+	static bool Start(const string& path)
+	{
+		RedisCapture& writer = GetWriter();
+		lock_guard<mutex> lk(writer.mtx);
+
+		if (writer.fp) fclose(writer.fp);
+
+		writer.conns.clear();
+
+		if ((writer.fp = fopen(path.c_str(), "wb")) == NULL)
+		{
+			writer.active = false;
+
+			return false;
+		}
+
+		fwrite("RCAP\1", 1, 5, writer.fp);
+
+		writer.last = GetClock();
+		writer.active = true;
+
+		return true;
+	}
+	static void Stop()
+	{
+		RedisCapture& writer = GetWriter();
+		lock_guard<mutex> lk(writer.mtx);
+
+		writer.active = false;
+
+		if (writer.fp)
+		{
+			fclose(writer.fp);
+			writer.fp = NULL;
+		}
+	}
+	static bool IsActive()
+	{
+		return GetWriter().active;
+	}
+	// 分配连接序号，每次建立连接时调用，用于区分录制数据所属的连接
+	static u_int64 NewSession()
+	{
+		static atomic<u_int64> seq(0);
+		return ++seq;
+	}
+	// 记录序号为session的连接发送的一段数据
+	static void Record(u_int64 session, const char* data, size_t len)
+	{
+		string tmp;
+		RedisCapture& writer = GetWriter();
+
+		if (writer.active == false || len == 0) return;
+
+		lock_guard<mutex> lk(writer.mtx);
+
+		if (writer.fp == NULL) return;
+
+		int64 now = GetClock();
+		auto res = writer.conns.insert(pair<u_int64, int>(session, (int)(writer.conns.size())));
+
+		if (Redact(data, len, tmp)) data = tmp.c_str();
+
+		writer.putVarint(max(now - writer.last, (int64)(0)));
+		writer.putVarint(res.first->second);
+		writer.putVarint(len);
+
+		fwrite(data, 1, len, writer.fp);
+
+		writer.last = max(now, writer.last);
+	}
+
+	RedisCapture()
+	{
+		active = false;
+	}
+	~RedisCapture()
+	{
+		close();
+	}
+	// 打开录制文件用于读取
+	bool open(const string& path)
+	{
+		char head[5];
+
+		close();
+
+		if ((fp = fopen(path.c_str(), "rb")) == NULL) return false;
+
+		if (fread(head, 1, 5, fp) == 5 && memcmp(head, "RCAP\1", 5) == 0)
+		{
+			last = 0;
+
+			return true;
+		}
+
+		close();
+
+		return false;
+	}
+	// 读取下一条记录，文件结束或格式错误时返回false
+	bool next(Frame& frame)
+	{
+		u_int64 delay, conn, len;
+
+		if (fp == NULL) return false;
+
+		if (getVarint(delay) && getVarint(conn) && getVarint(len) && len <= FRAME_MAXLEN)
+		{
+			frame.data.resize(len);
+
+			if (len == 0 || fread(&frame.data[0], 1, len, fp) == len)
+			{
+				frame.conn = (int)(conn);
+				frame.time = last += delay;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+	void close()
+	{
+		if (fp == NULL) return;
+
+		fclose(fp);
+		fp = NULL;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
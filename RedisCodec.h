@@ -0,0 +1,333 @@
+#ifndef XG_REDISCODEC_H
+#define XG_REDISCODEC_H
+//////////////////////////////////////////////////////////////////////////////
+#include "typedef.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 值压缩编码器：超过阈值的值压缩后加上8字节头部存储，读取时根据头部自动解压
+// 头部格式：\0 R Z 编码器编号(1字节) + 原始长度(4字节小端)
+// 不压缩的原始值如果以\0 R开头，写入时加上\0 R E前缀转义，读取时去掉，避免被误认为压缩数据。
+// 设置编码器之前写入的值没有转义，头部不合法(编号不符、长度与数据不匹配)时按原始值返回
+// 派生类实现compress/decompress即可接入其它压缩算法，编号用于区分不同的算法
+class RedisCodec
+{
+public:
+	static const int HEAD_SIZE = 8;
+	static const int ESCAPE_SIZE = 3;
+	static const int MAX_SIZE = 512 * 1024 * 1024;	// 解压后的最大长度(与Redis字符串的上限相同)
+
+	struct Stat
+	{
+		int64 encodeCount;	// 压缩次数
+		int64 encodeBytes;	// 压缩前的总字节数
+		int64 encodedBytes;	// 压缩后的总字节数(含头部)
+		int64 encodeTime;	// 压缩耗时(微秒)
+		int64 decodeCount;	// 解压次数
+		int64 decodeBytes;	// 解压后的总字节数
+		int64 decodeTime;	// 解压耗时(微秒)
+		int64 skipCount;	// 未达到阈值或压缩无收益而保持原样的次数
+
+		// 压缩率(压缩后/压缩前)
+		double getRatio() const
+		{
+			return encodeBytes > 0 ? (double)(encodedBytes) / encodeBytes : 1.0;
+		}
+	};
+
+protected:
+	u_char id;
+	int threshold;
+	atomic<int64> encodeCount;
+	atomic<int64> encodeBytes;
+	atomic<int64> encodedBytes;
+	atomic<int64> encodeTime;
+	atomic<int64> decodeCount;
+	atomic<int64> decodeBytes;
+	atomic<int64> decodeTime;
+	atomic<int64> skipCount;
+
+	// 将src压缩后追加到dest末尾，失败返回false
+	virtual bool compress(const char* src, int len, string& dest) = 0;
+	// 将src解压到dest，解压后的长度必须恰好为destlen，失败返回false
+	virtual bool decompress(const char* src, int len, char* dest, int destlen) = 0;
+	// len字节的压缩数据解压后的最大长度，用于在分配内存之前检查头部中的长度
+	virtual int64 getMaxExpand(int len) const
+	{
+		return (int64)(len) * 255 + 16;
+	}
+	// 不压缩：需要转义时写入dest并返回true
+	bool skip(const string& src, string& dest)
+	{
+		skipCount++;
+
+		if (IsReserved(src.c_str(), src.length()) == false) return false;
+
+		dest.assign("\0RE", ESCAPE_SIZE);
+		dest.append(src);
+
+		return true;
+	}
+	static int64 GetMicroTime()
+	{
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+public:
+	static bool IsEncoded(const char* str, int len)
+	{
+		return len >= HEAD_SIZE && str[0] == 0 && str[1] == 'R' && str[2] == 'Z';
+	}
+	// 以\0 R开头的原始值需要转义
+	static bool IsReserved(const char* str, int len)
+	{
+		return len >= 2 && str[0] == 0 && str[1] == 'R';
+	}
+	static bool IsEscaped(const char* str, int len)
+	{
+		return len >= ESCAPE_SIZE && str[0] == 0 && str[1] == 'R' && str[2] == 'E';
+	}
+	// 编码：长度达到阈值且压缩后更小时写入dest并返回true；原始值需要转义时转义结果写入dest并返回true；
+	// 否则返回false，调用方直接使用原始值
+	bool encode(const string& src, string& dest)
+	{
+		int len = src.length();
+
+		if (len < threshold) return skip(src, dest);
+
+		int64 stime = GetMicroTime();
+
+		dest.clear();
+		dest.reserve(HEAD_SIZE + len);
+		dest.push_back(0);
+		dest.push_back('R');
+		dest.push_back('Z');
+		dest.push_back((char)(id));
+
+		for (int i = 0; i < 4; i++) dest.push_back((char)((len >> (i * 8)) & 0xFF));
+
+		bool res = compress(src.c_str(), len, dest) && dest.length() < src.length();
+
+		encodeTime += GetMicroTime() - stime;
+
+		if (res == false) return skip(src, dest);
+
+		encodeCount++;
+		encodeBytes += len;
+		encodedBytes += dest.length();
+
+		return true;
+	}
+	// 解码：值不含压缩头部(或头部不合法)时返回0，去掉转义前缀或解压成功返回1并替换val的内容，
+	// 压缩数据损坏返回-1。头部中的长度在分配内存之前按压缩数据的长度和MAX_SIZE检查
+	int decode(string& val)
+	{
+		const char* str = val.c_str();
+
+		if (IsEscaped(str, val.length()))
+		{
+			val.erase(0, ESCAPE_SIZE);
+
+			return 1;
+		}
+
+		if (IsEncoded(str, val.length()) == false || (u_char)(str[3]) != id) return 0;
+
+		int len = 0;
+		string dest;
+		int64 stime = GetMicroTime();
+
+		for (int i = 0; i < 4; i++) len |= (int)((u_char)(str[4 + i])) << (i * 8);
+
+		if (len < 0 || len > MAX_SIZE || len > getMaxExpand(val.length() - HEAD_SIZE)) return 0;
+
+		dest.resize(len);
+
+		if (len > 0 && decompress(str + HEAD_SIZE, val.length() - HEAD_SIZE, &dest[0], len) == false) return -1;
+
+		decodeTime += GetMicroTime() - stime;
+		decodeCount++;
+		decodeBytes += len;
+
+		std::swap(val, dest);
+
+		return 1;
+	}
+	Stat getStat() const
+	{
+		Stat stat;
+
+		stat.encodeCount = encodeCount;
+		stat.encodeBytes = encodeBytes;
+		stat.encodedBytes = encodedBytes;
+		stat.encodeTime = encodeTime;
+		stat.decodeCount = decodeCount;
+		stat.decodeBytes = decodeBytes;
+		stat.decodeTime = decodeTime;
+		stat.skipCount = skipCount;
+
+		return stat;
+	}
+	int getThreshold() const
+	{
+		return threshold;
+	}
+	void setThreshold(int threshold)
+	{
+		this->threshold = threshold;
+	}
+	RedisCodec(u_char id, int threshold) : id(id), threshold(threshold)
+	{
+		encodeCount = encodeBytes = encodedBytes = encodeTime = 0;
+		decodeCount = decodeBytes = decodeTime = skipCount = 0;
+	}
+	virtual ~RedisCodec()
+	{
+	}
+};
+
+// 内置的LZ77快速压缩算法，块格式与LZ4相同：
+// 标记字节(高4位字面量长度，低4位匹配长度-4，值为15时后续字节累加) + 字面量 + 2字节偏移 + 扩展匹配长度
+class LZCodec : public RedisCodec
+{
+	static const int MINMATCH = 4;
+	static const int HASH_BITS = 14;
+	static const int MAX_OFFSET = 65535;
+
+	static u_int32 Read32(const char* str)
+	{
+		u_int32 val;
+
+		memcpy(&val, str, sizeof(val));
+
+		return val;
+	}
+	static void PutLength(string& dest, int len)
+	{
+		for (; len >= 255; len -= 255) dest.push_back((char)(255));
+
+		dest.push_back((char)(len));
+	}
+	static void PutSequence(string& dest, const char* str, int len, int offset, int mlen)
+	{
+		int ml = mlen - MINMATCH;
+
+		dest.push_back((char)(((len < 15 ? len : 15) << 4) | (mlen > 0 ? (ml < 15 ? ml : 15) : 0)));
+
+		if (len >= 15) PutLength(dest, len - 15);
+
+		dest.append(str, len);
+
+		if (mlen <= 0) return;	// 最后一个序列只有字面量
+
+		dest.push_back((char)(offset & 0xFF));
+		dest.push_back((char)((offset >> 8) & 0xFF));
+
+		if (ml >= 15) PutLength(dest, ml - 15);
+	}
+
+protected:
+	bool compress(const char* src, int len, string& dest)
+	{
+		int ip = 0;
+		int anchor = 0;
+		const int limit = len - 12;	// 末尾保留若干字节作为字面量
+		vector<int> table(1 << HASH_BITS, -1);	// 4字节序列哈希到最近出现的位置
+
+		while (ip < limit)
+		{
+			u_int32 seq = Read32(src + ip);
+			u_int32 hash = (seq * 2654435761U) >> (32 - HASH_BITS);
+			int ref = table[hash];
+
+			table[hash] = ip;
+
+			if (ref < 0 || ip - ref > MAX_OFFSET || Read32(src + ref) != seq)
+			{
+				ip++;
+
+				continue;
+			}
+
+			int mlen = MINMATCH;
+
+			while (ip + mlen < limit && src[ref + mlen] == src[ip + mlen]) mlen++;
+
+			PutSequence(dest, src + anchor, ip - anchor, ip - ref, mlen);
+
+			ip += mlen;
+			anchor = ip;
+		}
+
+		PutSequence(dest, src + anchor, len - anchor, 0, 0);
+
+		return true;
+	}
+	bool decompress(const char* src, int len, char* dest, int destlen)
+	{
+		const u_char* sp = (const u_char*)(src);
+		const u_char* send = sp + len;
+		char* dp = dest;
+		char* dend = dest + destlen;
+
+		auto GetLength = [&](int val) {
+			if (val < 15) return val;
+
+			while (sp < send)
+			{
+				int num = *sp++;
+
+				val += num;
+
+				if (num < 255) return val;
+			}
+
+			return -1;
+		};
+
+		while (sp < send)
+		{
+			int token = *sp++;
+			int num = GetLength(token >> 4);
+
+			if (num < 0 || num > send - sp || num > dend - dp) return false;
+
+			memcpy(dp, sp, num);
+			dp += num;
+			sp += num;
+
+			if (sp >= send) break;	// 最后一个序列
+
+			if (send - sp < 2) return false;
+
+			int offset = sp[0] | (sp[1] << 8);
+
+			sp += 2;
+
+			if (offset <= 0 || offset > dp - dest) return false;
+
+			if ((num = GetLength(token & 15)) < 0) return false;
+
+			num += MINMATCH;
+
+			if (num > dend - dp) return false;
+
+			// 匹配区域可能与输出重叠，需要逐字节复制
+			for (const char* ref = dp - offset; num > 0; num--) *dp++ = *ref++;
+		}
+
+		return dp == dend;
+	}
+
+public:
+	LZCodec(int threshold = 1024) : RedisCodec(1, threshold)
+	{
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
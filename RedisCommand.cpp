@@ -1,44 +1,1198 @@
 #include "RedisConnect.h"
 
+#include <deque>
+#include <random>
+
 #define ColorPrint(__COLOR__, __FMT__, ...)		\
 SetConsoleTextColor(__COLOR__);					\
 printf(__FMT__, __VA_ARGS__);					\
 SetConsoleTextColor(eWHITE);					\
 
-bool CheckCommand(const char* fmt, ...)
+bool CheckCommand(const char* fmt, ...)
+{
+	va_list args;
+	char buffer[64 * 1024] = {0};
+
+	va_start(args, fmt);
+	vsnprintf(buffer, sizeof(buffer) - 1, fmt, args);
+	va_end(args);
+
+	printf("%s", buffer);
+
+	while (true)
+	{
+		int n = getch();
+
+		if (n == 'Y' || n == 'y')
+		{
+			SetConsoleTextColor(eGREEN);
+			printf(" (YES)\n");
+			SetConsoleTextColor(eWHITE);
+
+			return true;
+		}
+		else if (n == 'N' || n == 'n')
+		{
+			SetConsoleTextColor(eRED);
+			printf(" (NO)\n");
+			SetConsoleTextColor(eWHITE);
+
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// 延迟直方图(微秒)：每个2的幂区间再等分为64个桶，相对误差不超过1.6%，可以合并
+struct Histogram
+{
+	int64 count = 0;
+	int64 total = 0;
+	int64 maxval = 0;
+	vector<int64> buckets = vector<int64>(128 + 48 * 64, 0);
+
+	static int GetIndex(int64 val)
+	{
+		if (val < 128) return (int)(val);
+
+		int shift = 0;
+
+		while ((val >> shift) >= 128) shift++;
+
+		return (int)(min(128 + (shift - 1) * 64 + (val >> shift) - 64, (int64)(128 + 48 * 64 - 1)));
+	}
+	static int64 GetValue(int idx)
+	{
+		if (idx < 128) return idx;
+
+		int shift = (idx - 128) / 64 + 1;
+
+		return ((int64)((idx - 128) % 64 + 64) << shift) + ((int64)(1) << shift) - 1;	// 取桶的上界
+	}
+	void add(int64 val)
+	{
+		buckets[GetIndex(val)]++;
+		maxval = max(maxval, val);
+		total += val;
+		count++;
+	}
+	void merge(const Histogram& obj)
+	{
+		for (size_t i = 0; i < buckets.size(); i++) buckets[i] += obj.buckets[i];
+
+		maxval = max(maxval, obj.maxval);
+		total += obj.total;
+		count += obj.count;
+	}
+	int64 percentile(double rate) const
+	{
+		int64 num = 0;
+		int64 expect = (int64)(rate * count + 0.5);
+
+		for (size_t i = 0; i < buckets.size(); i++)
+		{
+			if ((num += buckets[i]) >= expect && num > 0) return min(GetValue(i), maxval);
+		}
+
+		return maxval;
+	}
+	void print(const char* title, int64 elapsed) const
+	{
+		ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+		ColorPrint(eGREEN, "%s: %lld requests in %.3f seconds, %.0f requests per second\n", title, count, elapsed / 1000000.0, elapsed > 0 ? count * 1000000.0 / elapsed : 0.0);
+
+		if (count > 0)
+		{
+			ColorPrint(eWHITE, "latency(us): avg %lld p50 %lld p90 %lld p99 %lld p99.9 %lld max %lld\n", total / count, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), maxval);
+		}
+
+		ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+	}
+};
+
+// 从请求数据中解析完整的RESP命令，剩余的不完整数据保留在data中，格式错误返回false
+bool ParseRequest(string& data, vector<RedisConnect::Command>& cmds)
+{
+	size_t pos = 0;
+
+	while (pos < data.length())
+	{
+		if (data[pos] != '*') return false;
+
+		size_t end = data.find("\r\n", pos);
+
+		if (end == string::npos) break;
+
+		int num = atoi(data.c_str() + pos + 1);
+		size_t idx = end + 2;
+		vector<string> args;
+
+		for (int i = 0; i < num; i++)
+		{
+			if (idx >= data.length()) break;
+
+			if (data[idx] != '$') return false;
+
+			if ((end = data.find("\r\n", idx)) == string::npos) break;
+
+			size_t len = atol(data.c_str() + idx + 1);
+
+			if (end + 2 + len + 2 > data.length()) break;
+
+			args.push_back(data.substr(end + 2, len));
+			idx = end + 2 + len + 2;
+		}
+
+		if ((int)(args.size()) < num) break;
+
+		RedisConnect::Command cmd;
+
+		for (const string& item : args) cmd.add(item);
+
+		cmds.push_back(cmd);
+		pos = idx;
+	}
+
+	data.erase(0, pos);
+
+	return true;
+}
+
+// 有界阻塞队列，用于在读取(扫描)线程与工作线程之间传递任务
+template<class DATA_TYPE>
+class TaskQueue
+{
+	mutex mtx;
+	size_t maxlen;
+	bool closed = false;
+	deque<DATA_TYPE> queue;
+	condition_variable cv;
+
+public:
+	TaskQueue(size_t maxlen) : maxlen(max(maxlen, (size_t)(1)))
+	{
+	}
+	void push(DATA_TYPE&& item)
+	{
+		unique_lock<mutex> lk(mtx);
+
+		cv.wait(lk, [&]() {
+			return queue.size() < maxlen;
+		});
+
+		queue.push_back(std::move(item));
+		cv.notify_all();
+	}
+	// 队列为空时等待，队列关闭且为空时返回false
+	bool pop(DATA_TYPE& item)
+	{
+		unique_lock<mutex> lk(mtx);
+
+		cv.wait(lk, [&]() {
+			return closed || queue.size() > 0;
+		});
+
+		if (queue.empty()) return false;
+
+		item = std::move(queue.front());
+		queue.pop_front();
+		cv.notify_all();
+
+		return true;
+	}
+	void close()
+	{
+		lock_guard<mutex> lk(mtx);
+
+		closed = true;
+		cv.notify_all();
+	}
+};
+
+// 回放录制文件：按录制时的连接在conns个连接上回放，speed为回放倍速(小于等于0时全速回放)。
+// 先扫描一遍文件统计连接数，回放时逐条读取，经有界队列交给各连接的工作线程，内存占用与文件大小无关
+int Replay(const char* path, double speed, int conns)
+{
+	RedisCapture reader;
+	RedisCapture::Frame frame;
+
+	if (reader.open(path) == false)
+	{
+		ColorPrint(eRED, "打开录制文件[%s]失败\n", path);
+
+		return -1;
+	}
+
+	int maxconn = 0;
+
+	while (reader.next(frame)) maxconn = max(maxconn, frame.conn + 1);
+
+	if (maxconn == 0)
+	{
+		ColorPrint(eRED, "录制文件[%s]没有数据\n", path);
+
+		return -1;
+	}
+
+	if (conns <= 0) conns = maxconn;
+
+	conns = min(conns, maxconn);
+
+	reader.open(path);	// 回到文件开头，逐条读取回放
+
+	mutex mtx;
+	int64 errors = 0;
+	int64 skipped = 0;
+	Histogram result;
+	vector<thread> tasks;
+	vector<shared_ptr<TaskQueue<RedisCapture::Frame>>> queues;
+	const int64 start = RedisCapture::GetClock();
+
+	for (int i = 0; i < conns; i++) queues.push_back(make_shared<TaskQueue<RedisCapture::Frame>>(1024));
+
+	for (int i = 0; i < conns; i++)
+	{
+		tasks.push_back(thread([&, i]() {
+			int64 failed = 0;
+			int64 dropped = 0;
+			Histogram stat;
+			RedisCapture::Frame item;
+			map<int, string> pending;	// 录制连接上尚未解析完整的数据
+			shared_ptr<RedisConnect> redis = RedisConnect::Create();
+
+			while (queues[i]->pop(item))
+			{
+				vector<RedisConnect::Command> cmds;
+				string& data = pending[item.conn];
+
+				data += item.data;
+
+				if (ParseRequest(data, cmds) == false) data.clear();
+
+				// 验证、SELECT、事务、订阅和阻塞读取依赖原来的连接状态，回放时跳过
+				size_t count = cmds.size();
+
+				cmds.erase(remove_if(cmds.begin(), cmds.end(), [](const RedisConnect::Command& cmd) {
+					return cmd.isStateful();
+				}), cmds.end());
+
+				dropped += count - cmds.size();
+
+				if (cmds.empty()) continue;
+
+				if (speed > 0)
+				{
+					int64 delay = start + (int64)(item.time / speed) - RedisCapture::GetClock();
+
+					if (delay > 0) std::this_thread::sleep_for(chrono::microseconds(delay));
+				}
+
+				if (!redis || redis->isBroken())
+				{
+					if (redis && redis->reconnect() == false) redis = NULL;
+
+					if (!redis) redis = RedisConnect::Create();
+
+					if (!redis)
+					{
+						failed += cmds.size();
+
+						continue;
+					}
+				}
+
+				vector<RedisConnect::Command*> ptrs;
+
+				for (RedisConnect::Command& cmd : cmds) ptrs.push_back(&cmd);
+
+				int64 now = RedisCapture::GetClock();
+
+				redis->pipeline(ptrs, redis->getTimeout());
+
+				now = RedisCapture::GetClock() - now;
+
+				for (RedisConnect::Command& cmd : cmds)
+				{
+					if (cmd.getCode() < 0) failed++;
+
+					stat.add(now);
+				}
+			}
+
+			lock_guard<mutex> lk(mtx);
+
+			errors += failed;
+			skipped += dropped;
+			result.merge(stat);
+		}));
+	}
+
+	while (reader.next(frame)) queues[frame.conn % conns]->push(std::move(frame));
+
+	for (auto& queue : queues) queue->close();
+
+	for (thread& task : tasks) task.join();
+
+	result.print("replay", RedisCapture::GetClock() - start);
+
+	if (skipped > 0)
+	{
+		ColorPrint(eYELLOW, "跳过%lld条依赖连接状态的命令\n", skipped);
+	}
+
+	if (errors > 0)
+	{
+		ColorPrint(eRED, "失败%lld条命令\n", errors);
+	}
+
+	return 0;
+}
+
+// 压力测试：bench [参数=值 ...]，通过连接池以threads个线程并发执行混合命令，统计吞吐量和延迟分位数。
+// threads线程数，conns连接池大小，pipeline每次流水线发送的命令数，keys键空间大小，size值大小(如64或16-4096)，
+// mix命令比例(如get:80,set:20，支持get/set/incr/del/hget/hset/lpush/rpop)，requests请求总数，time测试秒数(优先于requests)，
+// uring为1时使用io_uring收发
+int Bench(int argc, char** argv)
+{
+	int time = 0;
+	int conns = 8;
+	int depth = 1;
+	int threads = 8;
+	int keys = 100000;
+	int minsize = 64;
+	int maxsize = 64;
+	int64 requests = 100000;
+	string prefix = "bench:";
+	string mix = "get:80,set:20";
+
+	for (int i = 2; i < argc; i++)
+	{
+		string name = argv[i];
+		size_t pos = name.find('=');
+
+		if (pos == string::npos) continue;
+
+		const char* val = argv[i] + pos + 1;
+
+		name = name.substr(0, pos);
+
+		if (name == "time") time = atoi(val);
+		else if (name == "conns") conns = atoi(val);
+		else if (name == "pipeline") depth = atoi(val);
+		else if (name == "threads") threads = atoi(val);
+		else if (name == "keys") keys = atoi(val);
+		else if (name == "requests") requests = atoll(val);
+		else if (name == "prefix") prefix = val;
+		else if (name == "mix") mix = val;
+		else if (name == "uring")
+		{
+			if (RedisConnect::SetUring(atoi(val) > 0) == false)
+			{
+				ColorPrint(eRED, "%s\n", "不支持io_uring(编译时需定义XG_URING)");
+
+				return -1;
+			}
+		}
+		else if (name == "size")
+		{
+			const char* ptr = strchr(val, '-');
+
+			minsize = maxsize = atoi(val);
+
+			if (ptr) maxsize = atoi(ptr + 1);
+		}
+	}
+
+	threads = max(threads, 1);
+	depth = max(depth, 1);
+	keys = max(keys, 1);
+	minsize = max(minsize, 0);
+	maxsize = max(maxsize, minsize);
+
+	vector<string> names;
+	vector<int> weights;
+	const char* cmds[] = {"get", "set", "incr", "del", "hget", "hset", "lpush", "rpop"};
+
+	for (size_t pos = 0; pos < mix.length();)
+	{
+		size_t end = mix.find(',', pos);
+
+		if (end == string::npos) end = mix.length();
+
+		string item = mix.substr(pos, end - pos);
+		size_t idx = item.find(':');
+		string name = item.substr(0, idx);
+		int weight = idx == string::npos ? 1 : atoi(item.c_str() + idx + 1);
+
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+		if (std::find(std::begin(cmds), std::end(cmds), name) == std::end(cmds))
+		{
+			ColorPrint(eRED, "不支持的命令[%s]\n", name.c_str());
+
+			return -1;
+		}
+
+		if (weight > 0)
+		{
+			names.push_back(name);
+			weights.push_back(weight);
+		}
+
+		pos = end + 1;
+	}
+
+	if (names.empty())
+	{
+		ColorPrint(eRED, "%s\n", "没有要执行的命令");
+
+		return -1;
+	}
+
+	RedisConnect::SetMaxConnCount(conns);
+	RedisConnect::Warmup();
+
+	ColorPrint(eWHITE, "threads %d conns %d pipeline %d keys %d size %d-%d mix %s %s %lld\n", threads, conns, depth, keys, minsize, maxsize, mix.c_str(), time > 0 ? "seconds" : "requests", time > 0 ? (int64)(time) : requests);
+
+	mutex mtx;
+	int64 errors = 0;
+	Histogram waits;	// 从连接池获取连接的耗时
+	vector<thread> tasks;
+	vector<Histogram> result(names.size());
+	atomic<int64> remain(requests);
+	const string value(maxsize, 'x');
+	const int64 start = RedisCapture::GetClock();
+	const int64 deadline = time > 0 ? start + time * 1000000LL : 0;
+
+	for (int i = 0; i < threads; i++)
+	{
+		tasks.push_back(thread([&, i]() {
+			int64 failed = 0;
+			Histogram acquire;
+			mt19937 rand(i * 7919 + (int)(start));
+			discrete_distribution<int> select(weights.begin(), weights.end());
+			uniform_int_distribution<int> keyrand(0, keys - 1);
+			uniform_int_distribution<int> sizerand(minsize, maxsize);
+			vector<Histogram> stat(names.size());
+
+			while (true)
+			{
+				int num = depth;
+
+				if (deadline > 0)
+				{
+					if (RedisCapture::GetClock() >= deadline) break;
+				}
+				else
+				{
+					int64 left = (remain -= depth) + depth;
+
+					if (left <= 0) break;
+
+					num = (int)(min(left, (int64)(depth)));
+				}
+
+				vector<int> types;
+				vector<RedisConnect::Command> cmds;
+
+				for (int j = 0; j < num; j++)
+				{
+					int type = select(rand);
+					int idx = keyrand(rand);
+					const string& name = names[type];
+					string key = prefix + to_string(idx);
+
+					types.push_back(type);
+					cmds.push_back(RedisConnect::Command(name == "incr" ? "incrby" : name));
+
+					RedisConnect::Command& cmd = cmds.back();
+
+					if (name == "get" || name == "del")
+					{
+						cmd.add(key);
+					}
+					else if (name == "set")
+					{
+						cmd.add(key, value.substr(0, sizerand(rand)));
+					}
+					else if (name == "incr")
+					{
+						cmd.add(prefix + "counter:" + to_string(idx), 1);
+					}
+					else if (name == "hget")
+					{
+						cmd.add(prefix + "hash:" + to_string(idx / 100), to_string(idx % 100));
+					}
+					else if (name == "hset")
+					{
+						cmd.add(prefix + "hash:" + to_string(idx / 100), to_string(idx % 100), value.substr(0, sizerand(rand)));
+					}
+					else if (name == "lpush")
+					{
+						cmd.add(prefix + "list", value.substr(0, sizerand(rand)));
+					}
+					else
+					{
+						cmd.add(prefix + "list");
+					}
+				}
+
+				int64 now = RedisCapture::GetClock();	// 延迟包含从连接池获取连接的等待时间
+				shared_ptr<RedisConnect> redis = RedisConnect::Instance();
+
+				acquire.add(RedisCapture::GetClock() - now);
+
+				if (!redis)
+				{
+					failed += num;
+
+					continue;
+				}
+
+				if (num == 1)
+				{
+					redis->execute(cmds[0]);
+				}
+				else
+				{
+					vector<RedisConnect::Command*> ptrs;
+
+					for (RedisConnect::Command& cmd : cmds) ptrs.push_back(&cmd);
+
+					redis->pipeline(ptrs, redis->getTimeout());
+				}
+
+				now = RedisCapture::GetClock() - now;
+
+				for (int j = 0; j < num; j++)
+				{
+					if (cmds[j].getCode() < 0 && cmds[j].getCode() != RedisConnect::NOTFOUND) failed++;
+
+					stat[types[j]].add(now);
+				}
+			}
+
+			lock_guard<mutex> lk(mtx);
+
+			errors += failed;
+			waits.merge(acquire);
+
+			for (size_t j = 0; j < stat.size(); j++) result[j].merge(stat[j]);
+		}));
+	}
+
+	for (thread& task : tasks) task.join();
+
+	int64 elapsed = RedisCapture::GetClock() - start;
+	Histogram total;
+
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		const Histogram& item = result[i];
+
+		total.merge(item);
+
+		if (names.size() > 1 && item.count > 0)
+		{
+			ColorPrint(eWHITE, "%-6s %lld requests, p50 %lld p99 %lld max %lld (us)\n", names[i].c_str(), item.count, item.percentile(0.5), item.percentile(0.99), item.maxval);
+		}
+	}
+
+	total.print("bench", elapsed);
+
+	if (waits.count > 0)
+	{
+		ColorPrint(eWHITE, "acquire connection p50 %lld p99 %lld max %lld (us)\n", waits.percentile(0.5), waits.percentile(0.99), waits.maxval);
+	}
+
+	if (errors > 0)
+	{
+		ColorPrint(eRED, "失败%lld条命令\n", errors);
+	}
+
+	return 0;
+}
+
+void PutVarint(string& out, u_int64 val)
+{
+	while (val >= 0x80)
+	{
+		out.push_back((char)(val | 0x80));
+		val >>= 7;
+	}
+
+	out.push_back((char)(val));
+}
+
+bool GetVarint(FILE* fp, u_int64& val)
+{
+	int ch;
+	int shift = 0;
+
+	val = 0;
+
+	while ((ch = fgetc(fp)) != EOF && shift < 64)
+	{
+		val |= (u_int64)(ch & 0x7F) << shift;
+
+		if ((ch & 0x80) == 0) return true;
+
+		shift += 7;
+	}
+
+	return false;
+}
+
+// 导出文件格式：头部"RDMP"加版本号，之后每个键依次为键名长度、键名、过期时间、DUMP数据长度(均为变长整数)和DUMP数据。
+// 版本2的过期时间为绝对时间(Unix毫秒数，0为永不过期)，导入时以RESTORE ... ABSTTL恢复(需要Redis 5.0及以上)，
+// 导出和导入之间经过的时间不会延长键的有效期；版本1为导出时的剩余毫秒数，仍可以导入
+struct DumpRecord
+{
+	string key;
+	int64 ttl = 0;
+	string data;
+};
+
+int64 GetUnixTime()
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// 流水线执行keys的DUMP和PTTL，把存在的键追加到out，返回导出的键数量，流水线失败时返回错误码
+int DumpKeys(shared_ptr<RedisConnect>& conn, const vector<string>& keys, string& out, int64& failed)
 {
-	va_list args;
-	char buffer[64 * 1024] = {0};
+	int num = 0;
+	vector<RedisConnect::Command> cmds;
+	vector<RedisConnect::Command*> ptrs;
 
-	va_start(args, fmt);
-	vsnprintf(buffer, sizeof(buffer) - 1, fmt, args);
-	va_end(args);
+	for (const string& key : keys)
+	{
+		cmds.push_back(RedisConnect::Command("dump"));
+		cmds.back().add(key);
+		cmds.push_back(RedisConnect::Command("pttl"));
+		cmds.back().add(key);
+	}
 
-	printf("%s", buffer);
+	for (RedisConnect::Command& cmd : cmds) ptrs.push_back(&cmd);
+
+	if (conn && conn->isBroken() && conn->reconnect() == false) conn = NULL;
+
+	if (!conn) conn = RedisConnect::Create();
+
+	if (!conn) return RedisConnect::NETERR;
+
+	int res = conn->pipeline(ptrs, conn->getTimeout());
+
+	if (res < 0) return res;
+
+	int64 now = GetUnixTime();
+
+	for (size_t j = 0; j < keys.size(); j++)
+	{
+		const RedisConnect::Command& dump = cmds[j * 2];
+		const RedisConnect::Command& pttl = cmds[j * 2 + 1];
+
+		if (dump.getCode() < 0 || pttl.getCode() < 0)
+		{
+			if (dump.getCode() != RedisConnect::NOTFOUND) failed++;	// 键在扫描之后被删除
+
+			continue;
+		}
+
+		int64 ttl = pttl.getReply().asInt64(-1);
+
+		if (ttl == -2) continue;
+
+		string data = dump.getReply().str();
+
+		PutVarint(out, keys[j].length());
+		out += keys[j];
+		PutVarint(out, ttl >= 0 ? now + ttl : 0);	// PTTL为0的键即将过期，不能写成0(永不过期)
+		PutVarint(out, data.length());
+		out += data;
+		num++;
+	}
+
+	return num;
+}
+
+// 以SCAN遍历匹配pattern的键，threads个工作线程各自使用独立连接流水线执行DUMP和PTTL，写入导出文件。
+// 整批失败时(如某个DUMP应答超过连接缓冲区)逐个键重试，有键导出失败时返回-1
+int Export(RedisConnect& redis, const char* path, const char* pattern, int threads)
+{
+	FILE* fp = fopen(path, "wb");
+
+	if (fp == NULL)
+	{
+		ColorPrint(eRED, "创建导出文件[%s]失败\n", path);
+
+		return -1;
+	}
+
+	fwrite("RDMP\2", 1, 5, fp);
+
+	mutex mtx;
+	int64 bytes = 5;
+	int64 count = 0;
+	int64 errors = 0;
+	vector<thread> tasks;
+	TaskQueue<vector<string>> queue(threads * 2);
+	const int64 start = RedisCapture::GetClock();
+
+	for (int i = 0; i < threads; i++)
+	{
+		tasks.push_back(thread([&]() {
+			vector<string> keys;
+			shared_ptr<RedisConnect> conn = RedisConnect::Create();
+
+			while (queue.pop(keys))
+			{
+				string out;
+				int64 failed = 0;
+				int num = DumpKeys(conn, keys, out, failed);
+
+				if (num < 0 && keys.size() > 1)
+				{
+					num = 0;
+
+					for (const string& key : keys)
+					{
+						int res = DumpKeys(conn, vector<string>(1, key), out, failed);
+
+						if (res < 0)
+						{
+							failed++;
+						}
+						else
+						{
+							num += res;
+						}
+					}
+				}
+				else if (num < 0)
+				{
+					num = 0;
+					failed++;
+				}
+
+				lock_guard<mutex> lk(mtx);
+
+				fwrite(out.c_str(), 1, out.length(), fp);
+
+				bytes += out.length();
+				errors += failed;
+				count += num;
+			}
+		}));
+	}
+
+	int res = 0;
+	string cursor = "0";
+
+	do
+	{
+		RedisConnect::Command cmd("scan");
+
+		cmd.add(cursor, "match", pattern, "count", 1000);
+
+		if (redis.execute(cmd) < 0 || cmd.getReply().size() < 2)
+		{
+			ColorPrint(eRED, "扫描键值失败[%s]\n", redis.getErrorString().c_str());
+
+			res = -1;
+
+			break;
+		}
+
+		vector<string> keys;
+		RedisConnect::Reply::Item list = cmd.getReply().root()[1];
+
+		cursor = cmd.getReply().root()[0].str();
+
+		for (int i = 0; i < list.size(); i++) keys.push_back(list[i].str());
+
+		if (keys.size() > 0) queue.push(std::move(keys));
+	}
+	while (cursor != "0");
+
+	queue.close();
+
+	for (thread& task : tasks) task.join();
+
+	fclose(fp);
+
+	ColorPrint(eGREEN, "导出%lld个键值到[%s]，共%lld字节，耗时%.3f秒\n", count, path, bytes, (RedisCapture::GetClock() - start) / 1000000.0);
+
+	if (errors > 0)
+	{
+		ColorPrint(eRED, "失败%lld个键值\n", errors);
+	}
+
+	return errors > 0 ? -1 : res;
+}
+
+// 读取导出文件，threads个工作线程各自使用独立连接流水线执行RESTORE ... REPLACE，有键导入失败时返回-1
+int Import(const char* path, int threads)
+{
+	char head[5];
+	FILE* fp = fopen(path, "rb");
+
+	if (fp == NULL || fread(head, 1, 5, fp) != 5 || memcmp(head, "RDMP", 4) || (head[4] != 1 && head[4] != 2))
+	{
+		ColorPrint(eRED, "打开导出文件[%s]失败\n", path);
+
+		if (fp) fclose(fp);
+
+		return -1;
+	}
+
+	mutex mtx;
+	int64 count = 0;
+	int64 errors = 0;
+	vector<thread> tasks;
+	const bool abs = head[4] == 2;	// 过期时间是否为绝对时间
+	TaskQueue<vector<DumpRecord>> queue(threads * 2);
+	const int64 start = RedisCapture::GetClock();
+
+	for (int i = 0; i < threads; i++)
+	{
+		tasks.push_back(thread([&]() {
+			vector<DumpRecord> list;
+			shared_ptr<RedisConnect> conn = RedisConnect::Create();
+
+			while (queue.pop(list))
+			{
+				int num = 0;
+				vector<RedisConnect::Command> cmds;
+				vector<RedisConnect::Command*> ptrs;
+
+				for (const DumpRecord& item : list)
+				{
+					cmds.push_back(RedisConnect::Command("restore"));
+					cmds.back().add(item.key, item.ttl, item.data, "replace");
+
+					if (abs && item.ttl > 0) cmds.back().add("absttl");
+				}
+
+				for (RedisConnect::Command& cmd : cmds) ptrs.push_back(&cmd);
+
+				if (conn && conn->isBroken() && conn->reconnect() == false) conn = NULL;
+
+				if (!conn) conn = RedisConnect::Create();
+
+				if (conn && conn->pipeline(ptrs, conn->getTimeout()) > 0)
+				{
+					for (RedisConnect::Command& cmd : cmds)
+					{
+						if (cmd.getCode() > 0) num++;
+					}
+				}
+
+				lock_guard<mutex> lk(mtx);
+
+				errors += list.size() - num;
+				count += num;
+			}
+		}));
+	}
+
+	int res = 0;
+	size_t bytes = 0;
+	vector<DumpRecord> list;
 
 	while (true)
 	{
-		int n = getch();
+		DumpRecord item;
+		u_int64 len, ttl;
 
-		if (n == 'Y' || n == 'y')
+		if (GetVarint(fp, len) == false) break;
+
+		item.key.resize(len);
+
+		if ((len > 0 && fread(&item.key[0], 1, len, fp) != len) || GetVarint(fp, ttl) == false || GetVarint(fp, len) == false)
 		{
-			SetConsoleTextColor(eGREEN);
-			printf(" (YES)\n");
-			SetConsoleTextColor(eWHITE);
+			res = -1;
 
-			return true;
+			break;
 		}
-		else if (n == 'N' || n == 'n')
+
+		item.ttl = ttl;
+		item.data.resize(len);
+
+		if (len > 0 && fread(&item.data[0], 1, len, fp) != len)
 		{
-			SetConsoleTextColor(eRED);
-			printf(" (NO)\n");
-			SetConsoleTextColor(eWHITE);
+			res = -1;
 
-			return false;
+			break;
+		}
+
+		bytes += item.key.length() + item.data.length();
+		list.push_back(std::move(item));
+
+		// 每批不超过BATCH_MAXLEN个键，数据量较大时提前发送
+		if (list.size() >= (size_t)(RedisConnect::BATCH_MAXLEN) || bytes >= 4 * 1024 * 1024)
+		{
+			queue.push(std::move(list));
+			list.clear();
+			bytes = 0;
 		}
 	}
 
-	return false;
+	if (list.size() > 0) queue.push(std::move(list));
+
+	queue.close();
+
+	for (thread& task : tasks) task.join();
+
+	fclose(fp);
+
+	if (res < 0)
+	{
+		ColorPrint(eRED, "导出文件[%s]数据不完整\n", path);
+	}
+
+	ColorPrint(eGREEN, "导入%lld个键值，耗时%.3f秒\n", count, (RedisCapture::GetClock() - start) / 1000000.0);
+
+	if (errors > 0)
+	{
+		ColorPrint(eRED, "失败%lld个键值\n", errors);
+	}
+
+	return errors > 0 ? -1 : res;
+}
+
+// 按前缀汇总的内存统计
+struct PrefixStat
+{
+	int64 count = 0;
+	int64 bytes = 0;
+	int64 ttls[5] = {0};	// 永不过期、1小时内、1天内、7天内、7天以上
+	map<string, int64> types;
+};
+
+struct KeyStat
+{
+	string key;
+	string type;
+	int64 bytes;
+	int64 ttl;
+
+	bool operator < (const KeyStat& obj) const
+	{
+		return bytes > obj.bytes;
+	}
+};
+
+// 内存分析：analyze [参数=值 ...]，以SCAN遍历键空间，每批流水线执行MEMORY USAGE、TYPE和PTTL，按前缀汇总。
+// pattern匹配模式，delims前缀分隔符(可以有多个字符)，depth前缀包含的分段数，rate每秒最多扫描的键数量，
+// batch每批的键数量，samples为MEMORY USAGE的SAMPLES参数，top输出的前缀和大键数量，有键值分析失败时返回-1
+int Analyze(RedisConnect& redis, int argc, char** argv)
+{
+	int top = 20;
+	int depth = 1;
+	int rate = 5000;
+	int batch = 100;
+	int samples = 5;
+	string delims = ":";
+	string pattern = "*";
+
+	for (int i = 2; i < argc; i++)
+	{
+		string name = argv[i];
+		size_t pos = name.find('=');
+
+		if (pos == string::npos) continue;
+
+		const char* val = argv[i] + pos + 1;
+
+		name = name.substr(0, pos);
+
+		if (name == "top") top = atoi(val);
+		else if (name == "depth") depth = atoi(val);
+		else if (name == "rate") rate = atoi(val);
+		else if (name == "batch") batch = atoi(val);
+		else if (name == "samples") samples = atoi(val);
+		else if (name == "delims") delims = val;
+		else if (name == "pattern") pattern = val;
+	}
+
+	top = max(top, 1);
+	depth = max(depth, 1);
+	batch = max(batch, 1);
+	samples = max(samples, 0);
+
+	auto GetPrefix = [&](const string& key) {
+		size_t pos = 0;
+
+		for (int i = 0; i < depth; i++)
+		{
+			size_t end = key.find_first_of(delims, pos);
+
+			if (end == string::npos) return i == 0 ? string("(no prefix)") : key.substr(0, pos - 1);
+
+			pos = end + 1;
+		}
+
+		return key.substr(0, pos - 1);
+	};
+
+	int64 total = 0;
+	int64 errors = 0;
+	int64 scanned = 0;
+	int64 analyzed = 0;
+	string cursor = "0";
+	vector<KeyStat> bigkeys;	// 按占用内存排序的最小堆
+	map<string, PrefixStat> stats;
+	const int64 start = RedisCapture::GetClock();
+
+	do
+	{
+		// 限速：每次SCAN之前等待，扫描到的键(包括出错、已删除的键，没有匹配的键时按一个计算)不超过rate每秒
+		if (rate > 0)
+		{
+			int64 delay = start + scanned * 1000000LL / rate - RedisCapture::GetClock();
+
+			if (delay > 0) std::this_thread::sleep_for(chrono::microseconds(delay));
+		}
+
+		RedisConnect::Command cmd("scan");
+
+		cmd.add(cursor, "match", pattern, "count", batch);
+
+		if (redis.execute(cmd) < 0 || cmd.getReply().size() < 2)
+		{
+			ColorPrint(eRED, "扫描键值失败[%s]\n", redis.getErrorString().c_str());
+
+			return -1;
+		}
+
+		vector<string> keys;
+		RedisConnect::Reply::Item list = cmd.getReply().root()[1];
+
+		cursor = cmd.getReply().root()[0].str();
+
+		for (int i = 0; i < list.size(); i++) keys.push_back(list[i].str());
+
+		scanned += max(list.size(), 1);
+
+		if (keys.empty()) continue;
+
+		vector<RedisConnect::Command> cmds;
+		vector<RedisConnect::Command*> ptrs;
+
+		for (const string& key : keys)
+		{
+			cmds.push_back(RedisConnect::Command("memory"));
+			cmds.back().add("usage", key, "samples", samples);
+			cmds.push_back(RedisConnect::Command("type"));
+			cmds.back().add(key);
+			cmds.push_back(RedisConnect::Command("pttl"));
+			cmds.back().add(key);
+		}
+
+		for (RedisConnect::Command& item : cmds) ptrs.push_back(&item);
+
+		if (redis.pipeline(ptrs, redis.getTimeout()) < 0)
+		{
+			ColorPrint(eRED, "分析键值失败[%s]\n", redis.getErrorString().c_str());
+
+			return -1;
+		}
+
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			KeyStat item;
+			const RedisConnect::Command& usage = cmds[i * 3];
+
+			item.ttl = cmds[i * 3 + 2].getReply().asInt64(-2);
+
+			if (item.ttl == -2) continue;	// 键在扫描之后被删除
+
+			if (usage.getCode() < 0 || usage.getReply().type() != ':')
+			{
+				errors++;
+
+				continue;
+			}
+
+			item.key = keys[i];
+			item.bytes = usage.getReply().asInt64();
+			item.type = cmds[i * 3 + 1].getReply().str();
+
+			PrefixStat& stat = stats[GetPrefix(item.key)];
+
+			if (item.ttl < 0)
+			{
+				stat.ttls[0]++;
+			}
+			else
+			{
+				stat.ttls[item.ttl < 3600000LL ? 1 : item.ttl < 86400000LL ? 2 : item.ttl < 7 * 86400000LL ? 3 : 4]++;
+			}
+
+			stat.types[item.type]++;
+			stat.bytes += item.bytes;
+			stat.count++;
+			total += item.bytes;
+			analyzed++;
+
+			if ((int)(bigkeys.size()) < top)
+			{
+				bigkeys.push_back(item);
+				push_heap(bigkeys.begin(), bigkeys.end());
+			}
+			else if (item.bytes > bigkeys.front().bytes)
+			{
+				pop_heap(bigkeys.begin(), bigkeys.end());
+				bigkeys.back() = item;
+				push_heap(bigkeys.begin(), bigkeys.end());
+			}
+		}
+	}
+	while (cursor != "0");
+
+	vector<pair<string, const PrefixStat*>> vec;
+
+	for (const auto& item : stats) vec.push_back(pair<string, const PrefixStat*>(item.first, &item.second));
+
+	sort(vec.begin(), vec.end(), [](const pair<string, const PrefixStat*>& a, const pair<string, const PrefixStat*>& b) {
+		return a.second->bytes > b.second->bytes;
+	});
+
+	ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+	ColorPrint(eGREEN, "分析%lld个键值，共%lld字节，%ld个前缀，耗时%.3f秒\n", analyzed, total, vec.size(), (RedisCapture::GetClock() - start) / 1000000.0);
+	ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+	ColorPrint(eWHITE, "%-32s %10s %12s %6s %8s  %s\n", "prefix", "keys", "bytes", "%", "avg", "ttl(none/1h/1d/7d/more) types");
+
+	for (size_t i = 0; i < vec.size() && (int)(i) < top; i++)
+	{
+		string types;
+		const PrefixStat& stat = *vec[i].second;
+
+		for (const auto& item : stat.types) types += " " + item.first + ":" + to_string(item.second);
+
+		ColorPrint(eWHITE, "%-32s %10lld %12lld %6.2f %8lld  %lld/%lld/%lld/%lld/%lld%s\n", vec[i].first.c_str(), stat.count, stat.bytes, total > 0 ? stat.bytes * 100.0 / total : 0.0, stat.bytes / stat.count, stat.ttls[0], stat.ttls[1], stat.ttls[2], stat.ttls[3], stat.ttls[4], types.c_str());
+	}
+
+	sort_heap(bigkeys.begin(), bigkeys.end());
+
+	ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+	ColorPrint(eWHITE, "%-48s %8s %12s %12s\n", "key", "type", "bytes", "ttl(ms)");
+
+	for (const KeyStat& item : bigkeys)
+	{
+		ColorPrint(eWHITE, "%-48s %8s %12lld %12lld\n", item.key.c_str(), item.type.c_str(), item.bytes, item.ttl);
+	}
+
+	ColorPrint(eWHITE, "%s\n", "--------------------------------------");
+
+	if (errors > 0)
+	{
+		ColorPrint(eRED, "获取%lld个键值的内存占用失败\n", errors);
+	}
+
+	return errors > 0 ? -1 : 0;
 }
 
 int main(int argc, char** argv)
@@ -130,6 +1284,38 @@ int main(int argc, char** argv)
 				ColorPrint(eRED, "删除键值[%s]失败\n", key);
 			}
 		}
+		else if (tmp == "EXPORT" && key && *key) // 导出键值：export <文件> [匹配模式] [线程数]
+		{
+			const char* threads = GetCmdParam(4);
+
+			RedisConnect::Setup(host, port, passwd ? passwd : "", 3000, 32 * 1024 * 1024);
+
+			return Export(redis, key, field ? field : "*", max(threads ? atoi(threads) : 4, 1));
+		}
+		else if (tmp == "IMPORT" && key && *key) // 导入键值：import <文件> [线程数]
+		{
+			RedisConnect::Setup(host, port, passwd ? passwd : "", 3000, 32 * 1024 * 1024);
+
+			return Import(key, max(field ? atoi(field) : 4, 1));
+		}
+		else if (tmp == "ANALYZE") // 内存分析：analyze [参数=值 ...]
+		{
+			return Analyze(redis, argc, argv);
+		}
+		else if (tmp == "BENCH") // 压力测试：bench [参数=值 ...]
+		{
+			RedisConnect::Setup(host, port, passwd ? passwd : "");
+
+			return Bench(argc, argv);
+		}
+		else if (tmp == "REPLAY" && key && *key) // 回放录制文件：replay <文件> [倍速(0为全速)] [连接数]
+		{
+			const char* conns = GetCmdParam(4);
+
+			RedisConnect::Setup(host, port, passwd ? passwd : "");
+
+			return Replay(key, field ? atof(field) : 1.0, conns ? atoi(conns) : 0);
+		}
 		else
 		{
 			int idx = 1;
@@ -2,6 +2,10 @@
 #define REDIS_CONNECT_H
 ///////////////////////////////////////////////////////////////
 #include "ResPool.h"
+#include "RedisCodec.h"
+#include "CircuitBreaker.h"
+#include "RedisCapture.h"
+#include "RedisUring.h"
 
 #ifdef XG_LINUX
 
@@ -14,7 +18,10 @@
 #include <sys/stat.h>
 #include <sys/file.h>
 #include <sys/types.h>
+#include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
 #include <sys/statfs.h>
@@ -29,14 +36,47 @@ typedef int SOCKET;
 
 #endif
 
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <type_traits>
+
 using namespace std;
 
+// 结构体与哈希的映射：在结构体中定义模板函数visit，并用REDIS_FIELD逐个列出需要映射的字段，字段名即哈希的field名
+//	struct User
+//	{
+//		int64 id;
+//		string name;
+//		double score;
+//
+//		template<class VISITOR> void visit(VISITOR& visitor)
+//		{
+//			REDIS_FIELD(id);
+//			REDIS_FIELD(name);
+//			REDIS_FIELD(score);
+//		}
+//	};
+#define REDIS_FIELD(name) visitor(#name, name)
+
+class RedisHedge;
+class RedisMultiplex;
+class RedisWriter;
+class RedisEndpoint;
+class RedisPager;
+
 class RedisConnect
 {
 	typedef std::mutex Mutex;
 	typedef std::lock_guard<mutex> Locker;
 
 	friend class Command;
+	friend class RedisHedge;
+	friend class RedisMultiplex;
+	friend class RedisWriter;
+	friend class RedisEndpoint;
+	friend class RedisPager;
 
 public:
 	static const int OK = 1;
@@ -52,16 +92,21 @@ public:
 	static const int NETCLOSE = -10;
 	static const int NETDELAY = -11;
 	static const int AUTHFAIL = -12;
+	static const int CONFLICT = -13;
 
 public:
 	static int POOL_MAXLEN;
-	static int SOCKET_TIMEOUT;
+	static int BATCH_MAXLEN;	// 批量命令单次发送的最大元素数量
+	static int SOCKET_TIMEOUT;	// 未指定截止时间时单次读写的默认等待时长(毫秒)
+	static atomic<bool> THREAD_CACHE;	// 是否为每个线程缓存独占的连接
+	static bool URING;	// 是否使用io_uring收发数据(编译时定义XG_URING)
 
 public:
 	class Socket
 	{
 	protected:
 		SOCKET sock = INVALID_SOCKET;	// 初始sock状态为-1
+		u_int64 session = 0;	// 录制流量时区分连接，每次建立连接时重新分配
 
 	public:
 		// 看是否超时，没有超时，返回0，超时了返回1
@@ -70,8 +115,61 @@ public:
 #ifdef XG_LINUX
 			return errno == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
 #else
-			return WSAGetLastError() == WSAETIMEDOUT;
+			int err = WSAGetLastError();
+
+			return err == WSAETIMEDOUT || err == WSAEWOULDBLOCK;
+#endif
+		}
+		// 获取单调时钟的毫秒数，不受系统时间调整影响，用于计算命令的截止时间
+		static int64 GetClock()
+		{
+			return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+		}
+		// 等待套接字可读(或可写)直到截止时间，就绪返回1，超时返回0，出错返回NETERR
+		static int SocketWait(SOCKET sock, bool writable, int64 deadline)
+		{
+			while (true)
+			{
+				int64 remain = deadline - GetClock();	// 剩余等待时间
+
+				if (remain < 0) remain = 0;
+
+#ifdef XG_LINUX
+				struct pollfd pfd;
+
+				pfd.fd = sock;
+				pfd.events = writable ? POLLOUT : POLLIN;
+				pfd.revents = 0;
+
+				int res = poll(&pfd, 1, (int)(remain));	// 阻塞等待事件，期间不占用CPU
+
+				if (res > 0) return 1;	// 错误和挂断事件也视为就绪，由随后的send/recv返回具体错误
+				if (res == 0) return 0;
+				if (errno == EINTR) continue;	// 被信号打断，按剩余时间继续等待
+#else
+				fd_set fs;
+				struct timeval tv;
+
+				FD_ZERO(&fs);
+				FD_SET(sock, &fs);
+
+				tv.tv_sec = (long)(remain / 1000);
+				tv.tv_usec = (long)(remain % 1000 * 1000);
+
+				int res = writable ? select(sock + 1, NULL, &fs, NULL, &tv) : select(sock + 1, &fs, NULL, NULL, &tv);
+
+				if (res > 0) return 1;
+				if (res == 0) return 0;
 #endif
+				return NETERR;
+			}
+		}
+		// 设置套接字的阻塞模式
+		static bool SocketSetBlocking(SOCKET sock, bool blocking)
+		{
+			u_long mode = blocking ? 0 : 1;
+
+			return ioctlsocket(sock, FIONBIO, &mode) == 0;
 		}
 		static void SocketClose(SOCKET sock)
 		{
@@ -119,87 +217,124 @@ public:
 #endif
 		}
 
-		// 设置超时连接
-		SOCKET SocketConnectTimeout(const char* ip, int port, int timeout)
+		// 同时等待多个套接字直到截止时间，writable指定各套接字等待可写还是可读，返回就绪数量并将就绪标记写入ready
+		static int SocketWaitAll(const vector<SOCKET>& socks, const vector<bool>& writable, vector<bool>& ready, int64 deadline)
+		{
+			int len = socks.size();
+
+			ready.assign(len, false);
+
+			if (len <= 0) return 0;
+
+			while (true)
+			{
+				int64 remain = deadline - GetClock();
+
+				if (remain < 0) remain = 0;
+
+#ifdef XG_LINUX
+				vector<struct pollfd> pfds(len);
+
+				for (int i = 0; i < len; i++)
+				{
+					pfds[i].fd = socks[i];
+					pfds[i].events = writable[i] ? POLLOUT : POLLIN;
+					pfds[i].revents = 0;
+				}
+
+				int res = poll(&pfds[0], len, (int)(remain));	// 一次系统调用等待所有套接字
+
+				if (res > 0)
+				{
+					for (int i = 0; i < len; i++) ready[i] = pfds[i].revents ? true : false;
+
+					return res;
+				}
+
+				if (res == 0) return 0;
+				if (errno == EINTR) continue;
+#else
+				fd_set rs;
+				fd_set ws;
+				SOCKET maxfd = 0;
+				struct timeval tv;
+
+				FD_ZERO(&rs);
+				FD_ZERO(&ws);
+
+				for (int i = 0; i < len; i++)
+				{
+					FD_SET(socks[i], writable[i] ? &ws : &rs);
+
+					if (socks[i] > maxfd) maxfd = socks[i];
+				}
+
+				tv.tv_sec = (long)(remain / 1000);
+				tv.tv_usec = (long)(remain % 1000 * 1000);
+
+				int res = select(maxfd + 1, &rs, &ws, NULL, &tv);
+
+				if (res > 0)
+				{
+					for (int i = 0; i < len; i++) ready[i] = FD_ISSET(socks[i], writable[i] ? &ws : &rs) ? true : false;
+
+					return res;
+				}
+
+				if (res == 0) return 0;
+#endif
+				return NETERR;
+			}
+		}
+		// 发起非阻塞连接，返回非阻塞模式的套接字，connected表示连接是否已经立即完成
+		static SOCKET SocketConnectAsync(const char* ip, int port, bool& connected)
 		{
-			u_long mode = 1;
 			struct sockaddr_in addr;
 			SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);	// 创建一个TCP套接字
 
+			connected = false;
+
 			if (IsSocketClosed(sock)) return INVALID_SOCKET;	// 如果套接字创建失败，则返回无效套接字
 
 			addr.sin_family = AF_INET;
 			addr.sin_port = htons(port);	// 设置端口号，并进行网络字节序转换
 			addr.sin_addr.s_addr = inet_addr(ip);	// 将IP地址字符串转换为网络字节序的32位整数
 
-			ioctlsocket(sock, FIONBIO, &mode); mode = 0;	// 设置套接字为非阻塞模式，以便进行超时连接
-
-			if (::connect(sock, (struct sockaddr*)(&addr), sizeof(addr)) == 0)
-			{
-				ioctlsocket(sock, FIONBIO, &mode);	// 连接成功后，将套接字设置为阻塞模式
+			SocketSetBlocking(sock, false);	// 设置套接字为非阻塞模式，以便进行超时连接
 
-				return sock;
-			}
+			if (::connect(sock, (struct sockaddr*)(&addr), sizeof(addr)) == 0) connected = true;
 
+			return sock;
+		}
+		// 检查非阻塞连接在可写之后是否成功建立
+		static bool IsSocketConnected(SOCKET sock)
+		{
+			int res = FAIL;
 #ifdef XG_LINUX
-			struct epoll_event ev;
-			struct epoll_event evs;
-			int handle = epoll_create(1);	// 创建一个epoll事件句柄
-
-			if (handle < 0)
-			{
-				SocketClose(sock);	// 关闭套接字
-			
-				return INVALID_SOCKET;
-			}
-			
-			memset(&ev, 0, sizeof(ev));
-			
-			ev.events = EPOLLOUT | EPOLLERR | EPOLLHUP;	// 监听写事件和错误事件
-			
-			epoll_ctl(handle, EPOLL_CTL_ADD, sock, &ev);	// 将套接字添加到epoll事件监听中
-			
-			if (epoll_wait(handle, &evs, 1, timeout) > 0) 	// 等待事件发生
-			{
-				if (evs.events & EPOLLOUT)	// 如果是写事件
-				{
-					int res = FAIL;
-					socklen_t len = sizeof(res);
-			
-					getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)(&res), &len); 	// 获取套接字的错误状态
-					ioctlsocket(sock, FIONBIO, &mode);	// 将套接字设置为阻塞模式
-			
-					if (res == 0)
-					{
-						::close(handle);	// 关闭epoll事件句柄
-			
-						return sock;
-					}
-				}
-			}
-			
-			::close(handle);
+			socklen_t len = sizeof(res);
 #else
-			struct timeval tv;
+			int len = sizeof(res);
+#endif
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)(&res), &len); 	// 获取套接字的错误状态
 
-			fd_set ws;
-			FD_ZERO(&ws);
-			FD_SET(sock, &ws);
+			return res == 0;
+		}
 
-			tv.tv_sec = timeout / 1000;
-			tv.tv_usec = timeout % 1000 * 1000;
+		// 设置超时连接，连接成功后套接字为阻塞模式
+		SOCKET SocketConnectTimeout(const char* ip, int port, int timeout)
+		{
+			bool connected = false;
+			SOCKET sock = SocketConnectAsync(ip, port, connected);
 
-			if (select(sock + 1, NULL, &ws, NULL, &tv) > 0)
+			if (IsSocketClosed(sock)) return INVALID_SOCKET;
+
+			// 等待连接完成
+			if (connected || (SocketWait(sock, true, GetClock() + timeout) > 0 && IsSocketConnected(sock)))
 			{
-				int res = ERROR;
-				int len = sizeof(res);
-			
-				getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)(&res), &len);
-				ioctlsocket(sock, FIONBIO, &mode);
-			
-				if (res == 0) return sock;
+				SocketSetBlocking(sock, true);	// 连接成功后，将套接字设置为阻塞模式
+
+				return sock;
 			}
-#endif
 
 			SocketClose(sock); 	// 关闭socket
 			
@@ -217,6 +352,20 @@ public:
 		{
 			return IsSocketClosed(sock);
 		}
+		SOCKET getHandle() const
+		{
+			return sock;
+		}
+		// 关闭连接的读写方向但保留句柄，用于唤醒阻塞在该连接上的其他线程
+		void shutdown()
+		{
+			if (IsSocketClosed(sock)) return;
+#ifdef XG_LINUX
+			::shutdown(sock, SHUT_RDWR);
+#else
+			::shutdown(sock, SD_BOTH);
+#endif
+		}
 		bool setSendTimeout(int timeout)
 		{
 			return SocketSetSendTimeout(sock, timeout);
@@ -225,220 +374,628 @@ public:
 		{
 			return SocketSetRecvTimeout(sock, timeout);
 		}
-		// 超时连接
+		// 接管一个已经建立连接的套接字
+		void attach(SOCKET sock)
+		{
+			close();
+
+			this->sock = sock;
+			this->session = RedisCapture::NewSession();
+		}
+		bool setBlocking(bool blocking)
+		{
+			return SocketSetBlocking(sock, blocking);
+		}
+		int wait(bool writable, int64 deadline)
+		{
+			return SocketWait(sock, writable, deadline);
+		}
+		// 超时连接，连接成功后套接字为非阻塞模式，读写均按截止时间等待
 		bool connect(const string& ip, int port, int timeout)
 		{
 			close();
 
 			sock = SocketConnectTimeout(ip.c_str(), port, timeout);
 
-			return IsSocketClosed(sock) ? false : true;
+			if (IsSocketClosed(sock)) return false;
+
+			session = RedisCapture::NewSession();
+
+			setBlocking(false);
+
+			return true;
+		}
+
+#ifdef XG_URING
+		// 通过当前线程的io_uring收发，返回收发的字节数、0(连接关闭)、TIMEOUT或NETERR，
+		// 未开启、截止时间已到或内核不支持等待时返回FAIL，由调用方按原来的方式处理
+		int UringExecute(bool reading, void* data, int count, int64 deadline)
+		{
+			RedisUring* ring = NULL;
+			int64 remain = deadline - GetClock();
+
+			if (URING == false || remain <= 0 || (ring = RedisUring::Local()) == NULL) return FAIL;
+
+			int res = reading ? ring->recv(sock, data, count, remain) : ring->send(sock, data, count, remain);
+
+			if (res >= 0) return res;
+			if (res == -ETIME) return TIMEOUT;
+			if (res == -EAGAIN || res == -EINTR) return FAIL;	// 旧内核对非阻塞套接字不等待
+
+			return NETERR;
 		}
+#endif
 
 	public:
-		int write(const void* data, int count)
+		// 发送数据直到全部发送完成或到达截止时间(deadline为0时等待SOCKET_TIMEOUT毫秒)
+		int write(const void* data, int count, int64 deadline = 0)
 		{
 			const char* str = (const char*)(data);	// 将数据转换为const char*类型
 
-			int num = 0;  // 用于记录每次发送的字节数
-    		int times = 0;  // 用于计数发送次数
-    		int writed = 0;  // 已发送的字节数
+			int num = 0;	// 每次发送的字节数
+			int writed = 0;	// 已发送的字节数
 
+			if (deadline <= 0) deadline = GetClock() + SOCKET_TIMEOUT;
+
+			if (RedisCapture::IsActive()) RedisCapture::Record(session, str, count);
 
 			while (writed < count)
 			{
-				if ((num = send(sock, str + writed, count - writed, 0)) > 0) 	// 发送数据，返回发送的字节数
+				if ((num = ::send(sock, str + writed, count - writed, 0)) > 0)	// 发送数据，返回发送的字节数
 				{
-					if (num > 8)
-					{
-						times = 0;	// 如果发送字节数大于8，重置计数器
-					}
-					else
-					{
-						if (++times > 100) return TIMEOUT;	// 如果连续发送次数超过100次，则返回超时错误
-					}
-
 					writed += num;	// 更新已发送的字节数
 				}
-				else
+				else if (IsSocketTimeout())	// 发送缓冲区已满
 				{
-					if (IsSocketTimeout())	// 检查是否发生了超时错误
+#ifdef XG_URING
+					// 一次系统调用完成等待和发送
+					if ((num = UringExecute(false, (char*)(str + writed), count - writed, deadline)) > 0)
 					{
-						if (++times > 100) return TIMEOUT;	// 如果连续发送次数超过100次，则返回超时错误
+						writed += num;
 
-						continue;	// 继续发送剩余数据
+						continue;
 					}
 
+					if (num == TIMEOUT || num == NETERR) return num;
+#endif
+					if ((num = SocketWait(sock, true, deadline)) < 0) return NETERR;
+
+					if (num == 0) return TIMEOUT;	// 到达截止时间仍不可写，返回超时错误
+				}
+				else
+				{
 					return NETERR;	// 发送错误，返回网络错误
 				}
 			}
 
 			return writed;	// 返回发送的总字节数
 		}
-		int read(void* data, int count, bool completed)
+		// 依次发送多段数据直到全部发送完成，Linux下以sendmsg一次提交多段而不需要拼接复制。
+		// 每次有数据发出后截止时间顺延timeout毫秒(大数据量时按停顿而不是总时长计算超时)，成功返回0
+		int write(const vector<pair<const char*, size_t>>& parts, int timeout)
 		{
-			char* str = (char*)(data);	// 将数据转换为char*类型
+			size_t idx = 0;
+			size_t offset = 0;	// 当前段已发送的字节数
+			int64 deadline = GetClock() + timeout;
 
-			if (completed)	// 如果要求读取完整数据
+			if (RedisCapture::IsActive())
 			{
-				int num = 0;	// 用于记录每次接收的字节数
-				int times = 0;	// 用于计数接收次数
-				int readed = 0;	// 已接收的字节数
+				for (const pair<const char*, size_t>& item : parts) RedisCapture::Record(session, item.first, item.second);
+			}
 
-				while (readed < count)	// 循环接收数据，直到接收完指定数量的字节
+			while (true)
+			{
+				while (idx < parts.size() && offset >= parts[idx].second)
 				{
-					// 接收数据，返回接收的字节数
-					if ((num = recv(sock, str + readed, count - readed, 0)) > 0)
-					{
-						if (num > 8)
-						{
-							times = 0;
-						}
-						else
-						{
-							if (++times > 100) return TIMEOUT;	// 如果连续接收次数超过100次，则返回超时错误
-						}
+					offset = 0;
+					idx++;
+				}
 
-						readed += num;	// 更新已接收的字节数
-					}
-					else if (num == 0)	// 如果返回值为0，表示连接已关闭
-					{
-						return NETCLOSE;	// 返回连接关闭错误
-					}
-					else	// 否则发生了接收错误
+				if (idx >= parts.size()) return 0;
+
+#ifdef XG_LINUX
+				int cnt = 0;
+				struct msghdr msg;
+				struct iovec iov[64];
+
+				for (size_t i = idx; i < parts.size() && cnt < 64; i++)
+				{
+					size_t skip = i == idx ? offset : 0;
+
+					iov[cnt].iov_base = (void*)(parts[i].first + skip);
+					iov[cnt++].iov_len = parts[i].second - skip;
+				}
+
+				memset(&msg, 0, sizeof(msg));
+
+				msg.msg_iov = iov;
+				msg.msg_iovlen = cnt;
+
+				int64 num = sendmsg(sock, &msg, 0);
+#else
+				int64 num = ::send(sock, parts[idx].first + offset, (int)(min(parts[idx].second - offset, (size_t)(1 << 30))), 0);
+#endif
+				if (num > 0)
+				{
+					deadline = GetClock() + timeout;
+
+					while (num > 0)
 					{
-						if (IsSocketTimeout())	// 检查是否发生了超时错误
-						{	
-							// 如果连续接收次数超过100次，则返回超时错误
-							if (++times > 100) return TIMEOUT;
+						size_t len = min((size_t)(num), parts[idx].second - offset);
 
-							continue;	// 继续接收剩余数据
-						}
+						offset += len;
+						num -= len;
 
-						return NETERR;	// 接收错误，返回网络错误
+						if (offset >= parts[idx].second)
+						{
+							offset = 0;
+							idx++;
+						}
 					}
 				}
+				else if (IsSocketTimeout())
+				{
+					if ((num = SocketWait(sock, true, deadline)) < 0) return NETERR;
 
-				return readed;	// 返回接收的总字节数
+					if (num == 0) return TIMEOUT;
+				}
+				else
+				{
+					return NETERR;
+				}
 			}
-			else// 如果不要求读取完整数据
+		}
+		// 接收数据，completed为真时需接收满count字节，否则有数据即返回，到达截止时间仍无数据返回0
+		int read(void* data, int count, bool completed, int64 deadline = 0)
+		{
+			char* str = (char*)(data);	// 将数据转换为char*类型
+
+			int num = 0;	// 每次接收的字节数
+			int readed = 0;	// 已接收的字节数
+
+			if (deadline <= 0) deadline = GetClock() + SOCKET_TIMEOUT;
+
+			while (readed < count)
 			{
-				int val = recv(sock, str, count, 0);	// 接收数据，返回接收的字节数
+				if ((num = ::recv(sock, str + readed, count - readed, 0)) > 0)	// 接收数据，返回接收的字节数
+				{
+					readed += num;	// 更新已接收的字节数
+
+					if (completed) continue;
 
-				if (val > 0) return val;	// 返回接收的字节数
+					break;
+				}
+
+				if (num == 0) return NETCLOSE;	// 返回值为0，表示连接已关闭
+
+				if (IsSocketTimeout() == false) return NETERR;	// 接收错误，返回网络错误
+
+#ifdef XG_URING
+				// 暂无数据可读：一次系统调用完成等待和接收，替代poll、recv
+				if ((num = UringExecute(true, str + readed, count - readed, deadline)) > 0)
+				{
+					readed += num;
+
+					if (completed) continue;
+
+					break;
+				}
 
-				if (val == 0) return NETCLOSE;	// 返回连接关闭错误
+				if (num == 0) return NETCLOSE;
 
-				if (IsSocketTimeout()) return 0;	// 如果发生超时错误，则返回0表示没有数据可读
+				if (num == TIMEOUT) return completed ? TIMEOUT : 0;
+
+				if (num == NETERR) return NETERR;
+#endif
+				if ((num = SocketWait(sock, false, deadline)) < 0) return NETERR;
 
-				return NETERR;	// 接收错误，返回网络错误
+				if (num == 0) return completed ? TIMEOUT : 0;	// 到达截止时间仍无数据可读
 			}
+
+			return readed;	// 返回接收的总字节数
 		}
 	};
 
-	class Command
+	// 类型化的应答：所有节点按前序顺序存放在同一个数组中，字符串内容统一存放在一块连续内存中，
+	// 解析时只有数组扩容才会分配内存，不会为每个元素单独分配
+	class Reply
 	{
 		friend RedisConnect;
 
 	protected:
-		int status;	// 命令的状态码
-		string msg;	// 命令的状态信息
-		vector<string> res;	// 命令的结果列表
-		vector<string> vec;	// 命令的参数列表
+		static const int MAX_DEPTH = 64;	// 数组的最大嵌套深度
 
-	protected:
-		int parse(const char* msg, int len)
-		{	
-			// 如果消息字符串以$开头
-			if (*msg == '$')
-			{
-				const char* end = parseNode(msg, len);	// 解析节点信息
+		struct Node
+		{
+			char type;		// 节点类型：+ - : $ *
+			int size;		// 字符串长度或数组元素个数，空值为-1
+			int offset;		// 文本在data中的偏移(数组为其子节点在links中的起始下标)
+			int64 value;	// 整数节点的数值
+		};
 
-				if (end == NULL) return DATAERR;	// 节点解析错误，返回数据错误
+		string data;		// 所有节点的文本内容(每段以\0结尾)
+		vector<int> links;	// 数组节点的子节点下标，同一数组的子节点连续存放
+		vector<Node> nodes;	// 节点数组，下标0为根节点
 
-				switch (end - msg)
-				{
-				case 0: return TIMEOUT;	// 超时错误
-				case -1: return NOTFOUND;	// 未找到
-				}
+	public:
+		class Item
+		{
+			friend Reply;
+
+		protected:
+			int idx;
+			const Reply* reply;
 
-				return OK;	// 解析成功
+			Item(const Reply* reply, int idx) : idx(idx), reply(reply)
+			{
+			}
+			const Node& node() const
+			{
+				return reply->nodes[idx];
 			}
 
-			const char* str = msg + 1;	// 跳过命令标识符
-			const char* end = strstr(str, "\r\n");	// 查找命令结束标志
+		public:
+			char type() const
+			{
+				return node().type;
+			}
+			bool isNil() const
+			{
+				return node().size < 0;
+			}
+			bool isArray() const
+			{
+				return node().type == '*';
+			}
+			bool isError() const
+			{
+				return node().type == '-';
+			}
+			bool isInteger() const
+			{
+				return node().type == ':';
+			}
+			bool isString() const
+			{
+				return (node().type == '$' || node().type == '+') && node().size >= 0;
+			}
+			// 数组返回元素个数，字符串返回长度，空值返回0
+			int size() const
+			{
+				return node().size < 0 ? 0 : node().size;
+			}
+			// 数组元素，下标越界时抛出out_of_range异常
+			Item at(int i) const
+			{
+				const Node& item = node();
 
-			if (end == NULL) return TIMEOUT;	// 超时错误
+				if (item.type != '*' || i < 0 || i >= item.size) throw out_of_range("reply index out of range");
 
-			if (*msg == '+' || *msg == '-' || *msg == ':')
+				return Item(reply, reply->links[item.offset + i]);
+			}
+			Item operator [] (int i) const
 			{
-				this->status = OK;
-				this->msg = string(str, end);	// 解析状态消息
-
-				if (*msg == '+') return OK;	// 返回成功状态
-				if (*msg == '-') return FAIL;	// 返回失败状态
+				return Item(reply, reply->links[node().offset + i]);
+			}
+			// 节点的文本内容(整数节点为其十进制文本)，数组和空值返回空字符串
+			const char* data() const
+			{
+				const Node& item = node();
 
-				this->status = atoi(str);	// 解析数字状态
+				if (item.type == '*' || item.size < 0) return "";
 
-				return OK;	// 解析成功
+				return reply->data.c_str() + item.offset;
 			}
+			int length() const
+			{
+				const Node& item = node();
 
-			if (*msg == '*')
+				if (item.type == '*' || item.size < 0) return 0;
+
+				return item.type == ':' ? strlen(data()) : item.size;
+			}
+			string str() const
+			{
+				return string(data(), length());
+			}
+			int64 asInt64(int64 def = 0) const
 			{
-				int cnt = atoi(str);	// 解析参数个数
-				const char* tail = msg + len;	// 命令尾部位置
+				const Node& item = node();
 
-				vec.clear();	// 清空参数列表
-				str = end + 2;	// 跳过参数个数和换行符
+				if (item.type == ':') return item.value;
 
-				while (cnt > 0)
-				{
-					if (*str == '*') return parse(str, tail - str);	// 递归解析子命令
+				if (item.type == '*' || item.size <= 0) return def;
 
-					end = parseNode(str, tail - str);	// 解析节点信息
+				char* end = NULL;
+				const char* str = data();
+				int64 val = strtoll(str, &end, 10);
 
-					if (end == NULL) return DATAERR;	// 节点解析错误
-					if (end == str) return TIMEOUT;	// 超时错误
+				return end == str + item.size ? val : def;
+			}
+			double asDouble(double def = 0) const
+			{
+				const Node& item = node();
 
-					str = end;
-					cnt--;
-				}
+				if (item.type == ':') return (double)(item.value);
 
-				return res.size();	// 返回结果列表的大小
+				if (item.type == '*' || item.size <= 0) return def;
+
+				char* end = NULL;
+				const char* str = data();
+				double val = strtod(str, &end);
+
+				return end == str + item.size ? val : def;
 			}
+		};
 
-			return DATAERR;
+	protected:
+		int save(const char* str, int len)
+		{
+			int offset = data.size();
+
+			data.append(str, len);
+			data.push_back(0);	// 以\0结尾，便于数值转换时直接使用
+
+			return offset;
 		}
-		const char* parseNode(const char* msg, int len)
+		// 解析一个节点，返回消耗的字节数，数据不完整返回0，协议错误返回DATAERR。
+		// depth为数组嵌套深度，超过MAX_DEPTH视为协议错误，避免恶意应答耗尽栈空间
+		int decode(const char* msg, int len, int& idx, int depth = 0)
 		{
-			const char* str = msg + 1;	// 跳过节点标识符
-			const char* end = strstr(str, "\r\n");	// 查找节点结束标志
+			if (len < 3) return 0;
 
-			if (end == NULL) return msg;	// 节点未完整接收，返回原始数据指针
+			const char* str = msg + 1;	// 跳过类型标识符
+			const char* tail = msg + len;
+			const char* end = (const char*)memchr(str, '\r', tail - str);	// 查找行结束标志
 
-			int sz = atoi(str);	// 解析节点大小
+			if (end == NULL || end + 1 >= tail) return 0;	// 行未完整接收
+			if (end[1] != '\n') return DATAERR;
 
-			if (sz < 0) return msg + sz;	// 负数表示引用之前已解析的节点
+			int head = end + 2 - msg;	// 首行长度
+			Node item = {*msg, 0, 0, 0};
 
-			str = end + 2;	// 跳过节点大小和换行符
-			end = str + sz + 2;	// 节点尾部位置
+			if (item.type != '+' && item.type != '-')
+			{
+				char* ptr = NULL;
 
-			if (msg + len < end) return msg;	// 节点未完整接收，返回原始数据指针
+				item.value = strtoll(str, &ptr, 10);
 
-			res.push_back(string(str, str + sz));	// 添加节点值到结果列表
+				if (ptr != end) return DATAERR;
+			}
 
-			return end;	// 返回节点结束位置
-		}
+			idx = nodes.size();
 
-	public:
-		Command()
-		{
-			this->status = 0;
-		}
-		Command(const string& cmd)
-		{
-			vec.push_back(cmd);
-			this->status = 0;
+			switch (item.type)
+			{
+			case '+':
+			case '-':
+			case ':':
+				item.size = end - str;
+				item.offset = save(str, item.size);
+				nodes.push_back(item);
+				return head;
+			case '$':
+				if (item.value < 0)
+				{
+					item.size = -1;
+					nodes.push_back(item);
+
+					return head;
+				}
+
+				if (item.value > INT_MAX - 2) return DATAERR;
+
+				str = end + 2;	// 跳过长度和换行符
+				item.size = (int)(item.value);
+
+				if (tail - str < item.size + 2) return 0;	// 内容未完整接收
+				if (str[item.size] != '\r' || str[item.size + 1] != '\n') return DATAERR;
+
+				item.offset = save(str, item.size);
+				nodes.push_back(item);
+
+				return head + item.size + 2;
+			case '*':
+				if (item.value < 0)
+				{
+					item.size = -1;
+					nodes.push_back(item);
+
+					return head;
+				}
+
+				if (item.value > INT_MAX || depth >= MAX_DEPTH) return DATAERR;
+
+				// 每个元素至少3个字节，已接收的数据不足时先不分配，避免按网络上的元素个数预留过大的空间
+				if (item.value > (len - head) / 3) return 0;
+
+				item.size = (int)(item.value);
+				item.offset = links.size();
+				nodes.push_back(item);
+				links.resize(item.offset + item.size);	// 预留子节点位置，保证同一数组的子节点连续
+
+				for (int i = 0; i < item.size; i++)
+				{
+					int child = 0;
+					int num = decode(msg + head, len - head, child, depth + 1);
+
+					if (num <= 0) return num;
+
+					links[item.offset + i] = child;
+					head += num;
+				}
+
+				return head;
+			}
+
+			return DATAERR;
+		}
+		void flatten(const Item& item, vector<string>& vec) const
+		{
+			if (item.isArray())
+			{
+				for (int i = 0; i < item.size(); i++) flatten(item[i], vec);
+			}
+			else
+			{
+				vec.push_back(item.str());	// 空值以空字符串占位，保持元素位置不变
+			}
+		}
+
+	public:
+		// 解析一条完整的应答，返回消耗的字节数，数据不完整返回0，协议错误返回DATAERR
+		int decode(const char* msg, int len)
+		{
+			int idx = 0;
+
+			clear();
+
+			return decode(msg, len, idx);
+		}
+		// 将应答展开为字符串列表(嵌套数组按顺序展开，状态和错误应答不包含在内)
+		void flatten(vector<string>& vec) const
+		{
+			vec.clear();
+
+			if (empty()) return;
+
+			Item item = root();
+
+			if (item.isArray() || (item.type() == '$' && !item.isNil())) flatten(item, vec);
+		}
+		void clear()
+		{
+			data.clear();
+			links.clear();
+			nodes.clear();
+		}
+		bool empty() const
+		{
+			return nodes.empty();
+		}
+		Item root() const
+		{
+			return Item(this, 0);
+		}
+
+	public:
+		char type() const
+		{
+			return empty() ? 0 : root().type();
+		}
+		bool isNil() const
+		{
+			return empty() || root().isNil();
+		}
+		bool isArray() const
+		{
+			return empty() ? false : root().isArray();
+		}
+		bool isError() const
+		{
+			return empty() ? false : root().isError();
+		}
+		int size() const
+		{
+			return empty() ? 0 : root().size();
+		}
+		Item at(int i) const
+		{
+			if (empty()) throw out_of_range("reply index out of range");
+
+			return root().at(i);
+		}
+		string str() const
+		{
+			return empty() ? string() : root().str();
+		}
+		int64 asInt64(int64 def = 0) const
+		{
+			return empty() ? def : root().asInt64(def);
+		}
+		double asDouble(double def = 0) const
+		{
+			return empty() ? def : root().asDouble(def);
+		}
+	};
+
+	class Command
+	{
+		friend RedisConnect;
+		friend RedisHedge;
+		friend RedisMultiplex;
+
+	protected:
+		int code;	// 命令的执行结果
+		int status;	// 命令的状态码
+		string msg;	// 命令的状态信息
+		Reply reply;	// 命令的类型化应答
+		mutable bool loaded;	// 结果列表是否已由应答展开
+		mutable vector<string> res;	// 命令的结果列表(按需由应答展开)
+		vector<string> vec;	// 命令的参数列表
+
+	protected:
+		int parse(const char* msg, int len)
+		{
+			int num = 0;
+
+			return parse(msg, len, num);
+		}
+		// 解析msg开头的一条应答，num返回该应答占用的字节数(数据不完整时为0)
+		int parse(const char* msg, int len, int& num)
+		{
+			num = reply.decode(msg, len);	// 解析为类型化应答
+
+			if (num == 0) return TIMEOUT;	// 数据不完整，继续接收
+			if (num < 0) return DATAERR;	// 协议错误
+
+			Reply::Item item = reply.root();
+
+			switch (item.type())
+			{
+			case '+':
+				this->status = OK;
+				this->msg = item.str();	// 解析状态消息
+				return OK;
+			case '-':
+				this->status = OK;
+				this->msg = item.str();
+				return FAIL;
+			case ':':
+				this->msg = item.str();
+				this->status = (int)(item.asInt64());	// 解析数字状态(完整的64位数值可通过getReply获取)
+				return OK;
+			case '$':
+				return item.isNil() ? NOTFOUND : OK;
+			}
+
+			return item.size();	// 返回数组元素的个数
+		}
+		void fetch(vector<string>& vec) const
+		{
+			if (loaded)
+			{
+				vec = res;
+			}
+			else
+			{
+				reply.flatten(vec);
+			}
+		}
+
+	public:
+		Command()
+		{
+			this->code = 0;
+			this->status = 0;
+			this->loaded = false;
+		}
+		Command(const string& cmd)
+		{
+			vec.push_back(cmd);
+			this->code = 0;
+			this->status = 0;
+			this->loaded = false;
 		}
 		void add(const char* val)
 		{
@@ -448,8 +1005,42 @@ public:
 		{
 			vec.push_back(val);
 		}
-		template<class DATA_TYPE> 
-		void add(DATA_TYPE val)
+		// 浮点数使用能够精确还原的最短格式，避免to_string只保留6位小数
+		void add(double val)
+		{
+			char tmp[32];
+			int len = snprintf(tmp, sizeof(tmp), "%.15g", val);
+
+			if (strtod(tmp, NULL) != val) len = snprintf(tmp, sizeof(tmp), "%.17g", val);
+
+			vec.push_back(string(tmp, len));
+		}
+		void add(float val)
+		{
+			add((double)(val));
+		}
+		// 整数直接在栈上格式化后放入参数列表，不经过to_string的临时字符串
+		template<class DATA_TYPE>
+		typename enable_if<is_integral<DATA_TYPE>::value>::type add(DATA_TYPE val)
+		{
+			char tmp[24];
+			char* end = tmp + sizeof(tmp);
+			char* str = end;
+			bool neg = is_signed<DATA_TYPE>::value && (long long)(val) < 0;
+			unsigned long long num = neg ? 0ULL - (unsigned long long)(val) : (unsigned long long)(val);
+
+			do
+			{
+				*--str = (char)('0' + num % 10);
+			}
+			while (num /= 10);
+
+			if (neg) *--str = '-';
+
+			vec.emplace_back(str, end - str);
+		}
+		template<class DATA_TYPE>
+		typename enable_if<!is_integral<DATA_TYPE>::value>::type add(DATA_TYPE val)
 		{
 			add(to_string(val));
 		}
@@ -461,114 +1052,270 @@ public:
 		}
 
 	public:
+		// 是否为改变连接状态或长时间占用连接的命令(验证、SELECT、事务、订阅、CLIENT、阻塞读取)，
+		// 这类命令不能在多个调用方共享的连接上执行，也不能脱离原来的连接单独回放
+		bool isStateful() const
+		{
+			static const char* names[] = {"auth", "hello", "select", "reset", "quit", "client", "monitor", "multi", "exec", "discard", "watch", "unwatch", "subscribe", "psubscribe", "ssubscribe", "unsubscribe", "punsubscribe", "sunsubscribe", "blpop", "brpop", "brpoplpush", "blmove", "blmpop", "bzpopmin", "bzpopmax", "bzmpop", "wait"};
+
+			if (vec.empty()) return false;
+
+			string name = vec[0];
+
+			for (char& ch : name) ch = tolower(ch);
+
+			for (const char* item : names)
+			{
+				if (name == item) return true;
+			}
+
+			if (name != "xread" && name != "xreadgroup") return false;
+
+			for (size_t i = 1; i < vec.size(); i++)
+			{
+				string arg = vec[i];
+
+				for (char& ch : arg) ch = tolower(ch);
+
+				if (arg == "block") return true;	// XREAD只有BLOCK选项会阻塞
+			}
+
+			return false;
+		}
 		string toString() const
 		{
-			ostringstream out; // 字符串类型输出流对象
+			string out;
+			char tmp[32];
+			size_t len = 16;
+
+			for (const string& item : vec) len += item.length() + 16;
 
-			out << "*" << vec.size() << "\r\n";	// 添加命令参数个数到字符串流
+			out.reserve(len);	// 预先计算长度，整条命令只分配一次内存
+			out.append(tmp, snprintf(tmp, sizeof(tmp), "*%d\r\n", (int)(vec.size())));	// 添加命令参数个数
 
 			for (const string& item : vec)
 			{
-				out << "$" << item.length() << "\r\n" << item << "\r\n";	// 添加参数长度和参数值到字符串流
+				out.append(tmp, snprintf(tmp, sizeof(tmp), "$%d\r\n", (int)(item.length())));	// 添加参数长度
+				out.append(item);
+				out.append("\r\n", 2);
 			}
 
-			return out.str();	// 将字符串流转换为字符串并返回
+			return out;
 		}
 		string get(int idx) const
 		{
-			return res.at(idx);
+			return getDataList().at(idx);
 		}
 		const vector<string>& getDataList() const
 		{
+			if (loaded == false)
+			{
+				reply.flatten(res);
+				loaded = true;
+			}
+
 			return res;
 		}
+		const Reply& getReply() const
+		{
+			return reply;
+		}
+
+		int getCode() const
+		{
+			return code;
+		}
+		int getStatus() const
+		{
+			return status;
+		}
+		const string& getMessage() const
+		{
+			return msg;
+		}
+		void reset()
+		{
+			code = 0;
+			status = 0;
+			msg.clear();
+			res.clear();
+			reply.clear();
+			loaded = false;
+		}
+		// 记录执行结果，返回错误码且没有错误信息时补充错误描述
+		void finish(int code)
+		{
+			this->code = code;
+
+			if (code >= 0 || msg.size() > 0) return;
+
+			switch (code)
+			{
+			case SYSERR:
+				msg = "system error";
+				break;
+			case NETERR:
+				msg = "network error";
+				break;
+			case DATAERR:
+				msg = "protocol error";
+				break;
+			case TIMEOUT:
+				msg = "response timeout";
+				break;
+			case NOTFOUND:
+				msg = "element not found";
+				break;
+			case CONFLICT:
+				msg = "transaction conflict";
+				break;
+			default:
+				msg = "unknown error";
+				break;
+			}
+		}
 
 		// 正常处理了结果，返回1
 		int getResult(RedisConnect* redis, int timeout)
 		{
-			auto doWork = [&]() {
-				string msg = toString();	// 将命令转换为字符串
-				Socket& sock = redis->sock;
+			const int64 deadline = Socket::GetClock() + timeout;	// 整条命令(发送和接收)的截止时间
 
-				if (sock.write(msg.c_str(), msg.length()) < 0) return NETERR;	// 将命令字符串写入套接字进行发送
+			if (redis->send(*this, deadline) < 0) return redis->code;
 
-				int len = 0;
-				int delay = 0;
-				int readed = 0;
-				char* dest = redis->buffer;
-				const int maxsz = redis->memsz;
+			// 超时后应答仍可能到达，由下一条命令读取时丢弃，避免应答与命令错位
+			if (redis->recv(*this, deadline) == TIMEOUT) redis->skip++;
 
-				while (readed < maxsz)
-				{	
-					// 从套接字读取响应数据
-					if ((len = sock.read(dest + readed, maxsz - readed, false)) < 0) return len;
+			return redis->code;	// 返回结果码
+		}
+	};
 
-					if (len == 0)
-					{
-						delay += SOCKET_TIMEOUT;	// 延迟时间累加
+	// MULTI/EXEC事务：收集的命令与MULTI、EXEC一起以一次写入流水线发送
+	class Transaction
+	{
+		friend RedisConnect;
 
-						if (delay > timeout) return TIMEOUT;	// 超时错误
-					}
-					else
-					{
-						dest[readed += len] = 0;	// 添加字符串结束符
+	protected:
+		Reply reply;	// EXEC的应答，依次为各条命令的结果
+		vector<Command> list;	// 事务中的命令列表
 
-						if ((len = parse(dest, readed)) == TIMEOUT)	// 解析响应数据
-						{
-							delay = 0;	// 重置延迟时间
-						}
-						else
-						{
-							return len;	// 返回解析结果
-						}
-					}
+	public:
+		template<class DATA_TYPE, class ...ARGS>
+		void add(DATA_TYPE val, ARGS ...args)
+		{
+			list.push_back(Command());
+			list.back().add(val, args...);
+		}
+		void clear()
+		{
+			list.clear();
+			reply.clear();
+		}
+		int size() const
+		{
+			return list.size();
+		}
+		// 第idx条命令的执行结果，事务未成功执行时抛出out_of_range异常
+		Reply::Item get(int idx) const
+		{
+			return reply.at(idx);
+		}
+		const Reply& getReply() const
+		{
+			return reply;
+		}
+	};
+
+	// 带熔断器的连接池：creator建立并验证新连接，由连接池按需调用(熔断期间不再尝试)，熔断后由后台探测线程
+	// 调用，探测建立的连接直接放入连接池。默认连接、命名端点和分片节点各使用一个
+	class Service
+	{
+	public:
+		ResPool<RedisConnect> pool;
+		CircuitBreaker breaker;	// 先于连接池析构，探测线程退出后才释放连接池
+
+		Service(function<shared_ptr<RedisConnect>()> creator, int maxlen)
+		{
+			pool.setLength(maxlen);
+			pool.setCreator([this, creator]() {
+				if (breaker.allow() == false) return shared_ptr<RedisConnect>();
+
+				shared_ptr<RedisConnect> redis = creator();
+
+				if (redis)
+				{
+					breaker.success();
+				}
+				else
+				{
+					breaker.failure();
 				}
 
-				return PARAMERR;	// 参数错误
-			};
+				return redis;
+			});
+			breaker.setProbe([this, creator]() {
+				int64 gen = pool.getEpoch();
+				shared_ptr<RedisConnect> redis = creator();
 
-			status = 0;
-			msg.clear();
+				if (!redis) return false;
+
+				pool.put(vector<shared_ptr<RedisConnect>>(1, redis), gen);
 
-			redis->code = doWork();	// 执行工作函数获取结果
+				return true;
+			});
+		}
+		// 熔断期间立即失败；连接池中已损坏的连接丢弃后重新获取，最多尝试连接池上限次，
+		// wait为连接池已满时最多等待的毫秒数
+		shared_ptr<RedisConnect> grasp(int priority = ResPool<RedisConnect>::NORMAL, int wait = 3000)
+		{
+			int64 endtime = Socket::GetClock() + wait;
 
-			if (redis->code < 0 && msg.empty())	// 如果返回错误码并且消息为空
+			for (int i = 0; i <= pool.getLength() && breaker.isOpen() == false; i++)
 			{
-				switch (redis->code)
+				shared_ptr<RedisConnect> redis = pool.get(priority, (int)(endtime - Socket::GetClock()));
+
+				if (!redis) return redis;
+
+				if (redis->isBroken() == false)
 				{
-				case SYSERR:
-					msg = "system error";
-					break;
-				case NETERR:
-					msg = "network error";
-					break;
-				case DATAERR:
-					msg = "protocol error";
-					break;
-				case TIMEOUT:
-					msg = "response timeout";
-					break;
-				case NOTFOUND:
-					msg = "element not found";
-					break;
-				default:
-					msg = "unknown error";
-					break;
+					breaker.success();	// 半开状态下取得可用连接(如探测建立的连接)即恢复
+
+					return redis;
 				}
+
+				pool.disable(redis);
 			}
 
-			redis->status = status;	// 更新连接状态
-			redis->msg = msg;	// 更新消息
+			return NULL;
+		}
+		// 沿用other的连接池容量、优先级调度和熔断参数，替换服务配置时使用
+		void inherit(Service& other)
+		{
+			ResPool<RedisConnect>::Stat stat = other.pool.getStat();
+			CircuitBreaker::Stat circuit = other.breaker.getStat();
 
-			return redis->code;	// 返回结果码
+			if (stat.minlen < stat.maxlen)
+			{
+				pool.setAdaptive(stat.minlen, stat.maxlen);
+			}
+			else
+			{
+				pool.setLength(stat.maxlen);
+			}
+
+			pool.setQos(stat.reserve, stat.weights[ResPool<RedisConnect>::HIGH], stat.weights[ResPool<RedisConnect>::NORMAL], stat.weights[ResPool<RedisConnect>::LOW]);
+			breaker.setThreshold(circuit.threshold, circuit.mindelay, circuit.maxdelay);
 		}
 	};
 
 protected:
+	int db = 0;
 	int code = 0;
 	int port = 0;
 	int memsz = 0;
+	int pos = 0;	// 缓冲区中未解析数据的起始位置
+	int skip = 0;	// 需要丢弃的应答数量(超时或对冲请求落后的命令)
 	int status = 0;
+	int readed = 0;	// 缓冲区中已接收数据的长度
 	int timeout = 0;
 	char* buffer = NULL;
 
@@ -576,6 +1323,7 @@ protected:
 	string host;
 	Socket sock;
 	string passwd;
+	shared_ptr<RedisCodec> codec;	// 值压缩编码器，为空时不压缩
 
 public:
 	~RedisConnect()
@@ -588,48 +1336,263 @@ public:
 	{
 		return status;
 	}
-	int getErrorCode() const
+	int getTimeout() const
+	{
+		return timeout;
+	}
+	void setTimeout(int timeout)
+	{
+		this->timeout = timeout;
+	}
+	shared_ptr<RedisCodec> getCodec() const
+	{
+		return codec;
+	}
+	void setCodec(shared_ptr<RedisCodec> codec)
+	{
+		this->codec = codec;
+	}
+	int getErrorCode() const
+	{
+		if (sock.isClosed()) return FAIL;
+
+		return code < 0 ? code : 0;
+	}
+	// 连接已关闭或出现了网络、超时、协议错误，应答流可能已经错位，不能继续使用。
+	// 超时但已记录待丢弃的应答(skip)时应答流没有错位，落后的应答由下一条命令丢弃，连接可以继续使用
+	bool isBroken() const
+	{
+		if (sock.isClosed()) return true;
+
+		if (code == TIMEOUT && skip > 0) return false;
+
+		return IsBrokenCode(code);
+	}
+	static bool IsBrokenCode(int code)
+	{
+		switch (code)
+		{
+		case IOERR:
+		case SYSERR:
+		case NETERR:
+		case TIMEOUT:
+		case DATAERR:
+		case PARAMERR:
+		case NETCLOSE:
+			return true;
+		}
+
+		return false;
+	}
+	string getErrorString() const
+	{
+		return msg;
+	}
+
+public:
+	void close()
+	{
+		if (buffer)
+		{
+			delete[] buffer;
+			buffer = NULL;
+		}
+
+		pos = skip = readed = 0;
+
+		sock.close();
+	}
+
+	// 重连
+	bool reconnect()
+	{
+		if (host.empty()) return false;
+
+		return connect(host, port, timeout, memsz) && auth(passwd) > 0 && select(db) > 0;
+	}
+	int execute(Command& cmd)
+	{
+		return cmd.getResult(this, timeout);
+	}
+	// 使用指定的超时时间(毫秒)执行命令，不影响连接的默认超时时间
+	int execute(Command& cmd, int timeout)
+	{
+		return cmd.getResult(this, timeout);
+	}
+	// 流水线执行多条命令：一次写入全部命令后依次读取各条应答，各命令的结果保存在对应的Command中，
+	// 全部应答接收完成时返回命令数量，网络或协议错误时关闭连接并返回错误码
+	int pipeline(vector<Command>& cmds)
+	{
+		vector<Command*> list;
+
+		for (Command& cmd : cmds) list.push_back(&cmd);
+
+		return pipeline(list, timeout);
+	}
+	int pipeline(const vector<Command*>& cmds, int timeout)
+	{
+		int len = 0;
+		int res = OK;
+		size_t idx = 0;
+		string data;
+		const int64 deadline = Socket::GetClock() + timeout;
+
+		for (Command* cmd : cmds)
+		{
+			cmd->reset();
+			data += cmd->toString();
+		}
+
+		if ((len = sock.write(data.c_str(), data.length(), deadline)) < 0) res = len;
+
+		for (; res > 0 && idx < cmds.size(); idx++)
+		{
+			int val = read(*cmds[idx], deadline);
+
+			if (IsBrokenCode(val))
+			{
+				res = val;
+
+				break;
+			}
+
+			cmds[idx]->finish(val);
+		}
+
+		if (res < 0)
+		{
+			while (idx < cmds.size()) cmds[idx++]->finish(res);
+
+			sock.close();	// 剩余应答无法与命令对应，连接不能继续使用
+		}
+
+		Command* last = cmds.empty() ? NULL : cmds.back();
+
+		code = res < 0 ? res : cmds.size();
+		status = last ? last->status : 0;
+		msg = last ? last->msg : string();
+
+		return code;
+	}
+	// 只发送命令不等待应答，之后调用recv读取应答。deadline为Socket::GetClock()时钟的截止时间，
+	// 可以先在多个连接上发送再一起等待，也可以连续发送多条后依次读取
+	int send(Command& cmd, int64 deadline)
+	{
+		int len = 0;
+		string data = cmd.toString();
+
+		cmd.reset();
+
+		if ((len = sock.write(data.c_str(), data.length(), deadline)) >= 0) return OK;
+
+		cmd.finish(code = len);
+
+		status = 0;
+		msg = cmd.msg;
+
+		return code;
+	}
+	// 读取下一条应答到cmd，到达截止时间时返回TIMEOUT，已接收的部分数据保留在缓冲区中，可以再次调用继续读取
+	int recv(Command& cmd, int64 deadline)
+	{
+		cmd.reset();
+		cmd.finish(code = read(cmd, deadline));
+
+		status = cmd.status;
+		msg = cmd.msg;
+
+		return code;
+	}
+	int watch(const vector<string>& keys)
 	{
-		if (sock.isClosed()) return FAIL;
+		Command cmd("watch");
 
-		return code < 0 ? code : 0;
+		for (const string& key : keys) cmd.add(key);
+
+		return execute(cmd);
 	}
-	string getErrorString() const
+	int unwatch()
 	{
-		return msg;
+		return execute("unwatch");
 	}
-
-public:
-	void close()
+	// 执行事务：MULTI、事务中的命令和EXEC以一次写入发送，一次往返完成。成功返回命令数量，
+	// 被WATCH的键已被修改时返回CONFLICT，命令入队失败时返回FAIL
+	int exec(Transaction& trans)
 	{
-		if (buffer)
+		Command head("multi");
+		Command tail("exec");
+		vector<Command*> cmds;
+
+		cmds.push_back(&head);
+
+		for (Command& cmd : trans.list) cmds.push_back(&cmd);
+
+		cmds.push_back(&tail);
+
+		trans.reply.clear();
+
+		if (pipeline(cmds, timeout) < 0) return code;
+
+		std::swap(trans.reply, tail.reply);
+
+		if (trans.reply.isNil())	// EXEC返回空值表示被WATCH的键已被修改，事务被放弃
 		{
-			delete[] buffer;
-			buffer = NULL;
+			tail.msg.clear();
+			tail.finish(CONFLICT);
 		}
 
-		sock.close();
-	}
+		status = tail.status;
+		msg = tail.msg;
 
-	// 重连
-	bool reconnect()
+		return code = tail.code < 0 ? tail.code : trans.size();
+	}
+	// 乐观锁事务：WATCH指定的键后调用func(trans)读取数据并构建事务，func返回false时放弃执行，
+	// 因被WATCH的键在此期间被修改而失败时自动重试，最多执行times次
+	template<class FUNC>
+	int transact(Transaction& trans, const vector<string>& keys, FUNC func, int times = 8)
 	{
-		if (host.empty()) return false;
+		for (int i = 0; i < times; i++)
+		{
+			trans.clear();
+
+			if (watch(keys) < 0) return code;
+
+			if (func(trans) == false)
+			{
+				unwatch();
 
-		return connect(host, port, timeout, memsz) && auth(passwd) > 0;
+				return code = FAIL;
+			}
+
+			if (exec(trans) != CONFLICT) break;
+		}
+
+		return code;
 	}
-	int execute(Command& cmd)
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(DATA_TYPE val, ARGS ...args)
 	{
+		Command cmd;
+
+		cmd.add(val, args...);
+
 		return cmd.getResult(this, timeout);
 	}
+	// 执行命令并获取类型化应答，reply的内存在多次调用之间复用
 	template<class DATA_TYPE, class ...ARGS>
-	int execute(DATA_TYPE val, ARGS ...args)
+	int execute(Reply& reply, DATA_TYPE val, ARGS ...args)
 	{
 		Command cmd;
 
 		cmd.add(val, args...);
 
-		return cmd.getResult(this, timeout);
+		std::swap(reply, cmd.reply);
+
+		cmd.getResult(this, timeout);
+
+		std::swap(reply, cmd.reply);
+
+		return code;
 	}
 	template<class DATA_TYPE, class ...ARGS>
 	int execute(vector<string>& vec, DATA_TYPE val, ARGS ...args)
@@ -640,7 +1603,7 @@ public:
 
 		cmd.getResult(this, timeout);
 
-		if (code > 0) std::swap(vec, cmd.res);
+		if (code > 0) cmd.fetch(vec);
 
 		return code;
 	}
@@ -651,9 +1614,6 @@ public:
 
 		if (sock.connect(host, port, timeout))
 		{
-			sock.setSendTimeout(SOCKET_TIMEOUT);
-			sock.setRecvTimeout(SOCKET_TIMEOUT);
-
 			this->host = host;
 			this->port = port;
 			this->memsz = memsz;
@@ -663,6 +1623,161 @@ public:
 
 		return buffer ? true : false;
 	}
+	// 按当前对象的配置并发建立count个连接：所有连接在同一个等待循环中完成握手，
+	// 随后各自以一次写入流水线发送AUTH/SELECT，总耗时约为一次往返而不是count倍
+	int spawn(vector<shared_ptr<RedisConnect>>& vec, int count) const
+	{
+		string init;	// 流水线发送的初始化命令
+		int expect = 0;	// 期望的应答数量
+
+		if (passwd.size() > 0)
+		{
+			Command cmd("auth");
+
+			cmd.add(passwd);
+			init += cmd.toString();
+			expect++;
+		}
+
+		if (db > 0)
+		{
+			Command cmd("select");
+
+			cmd.add(db);
+			init += cmd.toString();
+			expect++;
+		}
+
+		// step: 0-正在连接 1-等待初始化应答 2-完成 -1-失败
+		vector<int> step(count, 0);
+		vector<string> data(count);
+		vector<Socket> list(count);
+		vector<SOCKET> socks(count);
+		const int64 deadline = Socket::GetClock() + timeout;
+
+		auto doInit = [&](int idx) {
+			if (expect == 0) return step[idx] = 2;
+
+			if (list[idx].write(init.c_str(), init.length(), deadline) < 0) return step[idx] = -1;
+
+			return step[idx] = 1;
+		};
+
+		for (int i = 0; i < count; i++)
+		{
+			bool connected = false;
+
+			list[i].attach(socks[i] = Socket::SocketConnectAsync(host.c_str(), port, connected));
+
+			if (list[i].isClosed())
+			{
+				step[i] = -1;
+			}
+			else if (connected)
+			{
+				doInit(i);
+			}
+		}
+
+		while (true)
+		{
+			vector<int> idxs;
+			vector<bool> ready;
+			vector<bool> writable;
+			vector<SOCKET> waits;
+
+			for (int i = 0; i < count; i++)
+			{
+				if (step[i] == 0 || step[i] == 1)
+				{
+					idxs.push_back(i);
+					waits.push_back(socks[i]);
+					writable.push_back(step[i] == 0);
+				}
+			}
+
+			if (idxs.empty()) break;
+
+			if (Socket::SocketWaitAll(waits, writable, ready, deadline) <= 0) break;
+
+			for (size_t n = 0; n < idxs.size(); n++)
+			{
+				if (ready[n] == false) continue;
+
+				int idx = idxs[n];
+
+				if (step[idx] == 0)
+				{
+					if (Socket::IsSocketConnected(socks[idx]))
+					{
+						doInit(idx);
+					}
+					else
+					{
+						step[idx] = -1;
+					}
+
+					continue;
+				}
+
+				char tmp[1024];
+				int len = list[idx].read(tmp, sizeof(tmp), false, deadline);
+
+				if (len <= 0)
+				{
+					step[idx] = -1;
+
+					continue;
+				}
+
+				string& msg = data[idx];
+				int lines = 0;
+
+				msg.append(tmp, len);
+
+				// AUTH和SELECT的应答均为单行状态，按行计数即可判断是否接收完整
+				for (size_t pos = msg.find("\r\n"); pos != string::npos; pos = msg.find("\r\n", pos + 2)) lines++;
+
+				if (lines < expect) continue;
+
+				step[idx] = 2;
+
+				for (size_t pos = 0, i = 0; i < (size_t)(expect); i++, pos = msg.find("\r\n", pos) + 2)
+				{
+					if (msg[pos] == '-') step[idx] = -1;	// 任意一条初始化命令失败则放弃该连接
+				}
+			}
+		}
+
+		int num = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			if (step[i] != 2)
+			{
+				list[i].close();
+
+				continue;
+			}
+
+			shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
+
+			redis->sock.attach(socks[i]);
+			redis->db = db;
+			redis->host = host;
+			redis->port = port;
+			redis->codec = codec;
+			redis->memsz = memsz;
+			redis->passwd = passwd;
+			redis->timeout = timeout;
+			redis->buffer = new char[memsz + 1];
+
+			vec.push_back(redis);
+			num++;
+		}
+
+		return num;
+	}
 
 public:
 	int ping()
@@ -689,6 +1804,14 @@ public:
 
 		return execute("auth", passwd);
 	}
+	int select(int db)
+	{
+		this->db = db;
+
+		if (db <= 0) return OK;
+
+		return execute("select", db);
+	}
 	int get(const string& key, string& val)
 	{
 		vector<string> vec;
@@ -697,7 +1820,7 @@ public:
 
 		val = vec[0];
 
-		return code;
+		return unpack(val);
 	}
 	int decr(const string& key, int val = 1)
 	{
@@ -727,15 +1850,167 @@ public:
 
 		val = vec[0];
 
-		return code;
+		return unpack(val);
 	}
 	int set(const string& key, const string& val, int timeout = 0)
 	{
-		return timeout > 0 ? execute("setex", key, timeout, val) : execute("set", key, val);
+		string tmp;
+		const string& data = pack(val, tmp);
+
+		return timeout > 0 ? execute("setex", key, timeout, data) : execute("set", key, data);
 	}
 	int hset(const string& key, const string& filed, const string& val)
 	{
-		return execute("hset", key, filed, val);
+		string tmp;
+
+		return execute("hset", key, filed, pack(val, tmp));
+	}
+
+public:
+	// 流式读取大值：内容随接收分块交给sink(返回false时中止并关闭连接)，内存占用不随值的大小增长。
+	// 读取的是存储的原始字节(不经过编码器解压)，键不存在返回NOTFOUND
+	int get(const string& key, function<bool(const char*, int)> sink)
+	{
+		Command cmd("get");
+
+		cmd.add(key);
+
+		if (send(cmd, Socket::GetClock() + timeout) < 0) return code;
+
+		int res = stream(cmd, sink);
+
+		if (IsBrokenCode(res) || res == IOERR) sock.close();	// 应答只读取了一部分，连接不能继续使用
+
+		cmd.finish(code = res);
+
+		status = cmd.status;
+		msg = cmd.msg;
+
+		return code;
+	}
+	// 流式读取大值并写入文件描述符
+	int get(const string& key, int fd)
+	{
+		return get(key, [fd](const char* data, int len) {
+			while (len > 0)
+			{
+				int num = ::write(fd, data, len);
+
+				if (num <= 0) return false;
+
+				data += num;
+				len -= num;
+			}
+
+			return true;
+		});
+	}
+	// 流式读取大值并保存到文件
+	int getFile(const string& key, const string& path)
+	{
+		FILE* fp = fopen(path.c_str(), "wb");
+
+		if (fp == NULL) return code = IOERR;
+
+		int res = get(key, [fp](const char* data, int len) {
+			return fwrite(data, 1, len, fp) == (size_t)(len);
+		});
+
+		if (fclose(fp) != 0 && res > 0) return code = IOERR;
+
+		return res;
+	}
+	// 流式写入大值：值由多段内存(如mmap映射的文件、iovec列表)依次组成，直接从各段内存发送而不拼接复制，
+	// timeout大于0时设置过期时间(秒)。写入的是原始字节(不经过编码器压缩)
+	int setv(const string& key, const vector<pair<const char*, size_t>>& parts, int timeout = 0)
+	{
+		size_t len = 0;
+
+		for (const pair<const char*, size_t>& item : parts) len += item.second;
+
+		return setValue(key, len, timeout, [&](const string& head, const string& tail) {
+			vector<pair<const char*, size_t>> vec;
+
+			vec.reserve(parts.size() + 2);
+			vec.push_back(pair<const char*, size_t>(head.c_str(), head.length()));
+			vec.insert(vec.end(), parts.begin(), parts.end());
+			vec.push_back(pair<const char*, size_t>(tail.c_str(), tail.length()));
+
+			return sock.write(vec, this->timeout);
+		});
+	}
+	// 流式写入文件内容：Linux下将文件映射到内存后直接发送，其它平台分块读取发送
+	int setFile(const string& key, const string& path, int timeout = 0)
+	{
+#ifdef XG_LINUX
+		struct stat st;
+		int fd = open(path.c_str(), O_RDONLY);
+
+		if (fd < 0) return code = IOERR;
+
+		if (fstat(fd, &st) < 0)
+		{
+			::close(fd);
+
+			return code = IOERR;
+		}
+
+		vector<pair<const char*, size_t>> parts;
+		void* data = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+
+		::close(fd);
+
+		if (data == MAP_FAILED) return code = IOERR;
+
+		if (data)
+		{
+			madvise(data, st.st_size, MADV_SEQUENTIAL);	// 顺序读取，内核提前预读并及时回收页面
+			parts.push_back(pair<const char*, size_t>((const char*)(data), st.st_size));
+		}
+
+		int res = setv(key, parts, timeout);
+
+		if (data) munmap(data, st.st_size);
+
+		return res;
+#else
+		FILE* fp = fopen(path.c_str(), "rb");
+
+		if (fp == NULL) return code = IOERR;
+
+		fseek(fp, 0, SEEK_END);
+
+		long len = ftell(fp);
+
+		fseek(fp, 0, SEEK_SET);
+
+		int res = setValue(key, len, timeout, [&](const string& head, const string& tail) {
+			int val = 0;
+			string data(64 * 1024, '\0');
+			vector<pair<const char*, size_t>> vec(1, pair<const char*, size_t>(head.c_str(), head.length()));
+
+			if ((val = sock.write(vec, this->timeout)) < 0) return val;
+
+			for (long remain = len; remain > 0; remain -= vec[0].second)
+			{
+				size_t num = fread(&data[0], 1, min((long)(data.length()), remain), fp);
+
+				if (num == 0) return IOERR;	// 文件在发送期间被截断
+
+				vec[0] = pair<const char*, size_t>(data.c_str(), num);
+
+				if ((val = sock.write(vec, this->timeout)) < 0) return val;
+			}
+
+			vec[0] = pair<const char*, size_t>(tail.c_str(), tail.length());
+
+			return sock.write(vec, this->timeout);
+		});
+
+		fclose(fp);
+
+		return res;
+#endif
 	}
 
 public:
@@ -771,31 +2046,188 @@ public:
 	{
 		return execute("lpush", key, val);
 	}
-	int rpush(const string& key, const string& val)
+	int rpush(const string& key, const string& val)
+	{
+		return execute("rpush", key, val);
+	}
+	int range(vector<string>& vec, const string& key, int start, int end)
+	{
+		return execute(vec, "lrange", key, start, end);
+	}
+	int lrange(vector<string>& vec, const string& key, int start, int end)
+	{
+		return execute(vec, "lrange", key, start, end);
+	}
+
+public:
+	int zrem(const string& key, const string& filed)
+	{
+		return execute("zrem", key, filed);
+	}
+	int zadd(const string& key, const string& filed, int score)
+	{
+		return execute("zadd", key, score, filed);
+	}
+	int zrange(vector<string>& vec, const string& key, int start, int end, bool withscore = false)
+	{
+		return withscore ? execute(vec, "zrange", key, start, end, "withscores") : execute(vec, "zrange", key, start, end);
+	}
+
+public:
+	// 批量获取键值，结果与keys一一对应(不存在的键为空字符串)，返回存在的键数量
+	int mget(const vector<string>& keys, vector<string>& vals)
+	{
+		int num = 0;
+		int err = 0;
+		vector<string> head(1, "mget");
+
+		vals.assign(keys.size(), string());
+
+		int res = executeBatch(head, keys, 1, [&](const Reply& reply, int start) {
+			for (int i = 0; i < reply.size(); i++)
+			{
+				Reply::Item item = reply.at(i);
+
+				if (item.isNil()) continue;
+
+				vals[start + i].assign(item.data(), item.length());
+				num++;
+
+				if (unpack(vals[start + i]) < 0) err = code;
+			}
+		});
+
+		return res < 0 ? res : (err < 0 ? err : num);
+	}
+	// 批量设置键值，data为键值对容器(如map<string, string>)
+	template<class DATA_MAP>
+	int mset(const DATA_MAP& data)
+	{
+		vector<string> list;
+		vector<string> head(1, "mset");
+
+		list.reserve(data.size() * 2);
+
+		for (const auto& item : data)
+		{
+			list.push_back(item.first);
+			list.push_back(item.second);
+			pack(list.back());
+		}
+
+		return executeBatch(head, list, 2, NULL);
+	}
+	// 批量获取哈希字段，结果与fields一一对应(不存在的字段为空字符串)，返回存在的字段数量
+	int hmget(const string& key, const vector<string>& fields, vector<string>& vals)
+	{
+		int num = 0;
+		int err = 0;
+		vector<string> head;
+
+		head.push_back("hmget");
+		head.push_back(key);
+
+		vals.assign(fields.size(), string());
+
+		int res = executeBatch(head, fields, 1, [&](const Reply& reply, int start) {
+			for (int i = 0; i < reply.size(); i++)
+			{
+				Reply::Item item = reply.at(i);
+
+				if (item.isNil()) continue;
+
+				vals[start + i].assign(item.data(), item.length());
+				num++;
+
+				if (unpack(vals[start + i]) < 0) err = code;
+			}
+		});
+
+		return res < 0 ? res : (err < 0 ? err : num);
+	}
+	// 批量设置哈希字段，data为字段和值的键值对容器
+	template<class DATA_MAP>
+	int hmset(const string& key, const DATA_MAP& data)
 	{
-		return execute("rpush", key, val);
+		vector<string> list;
+		vector<string> head;
+
+		head.push_back("hset");
+		head.push_back(key);
+		list.reserve(data.size() * 2);
+
+		for (const auto& item : data)
+		{
+			list.push_back(item.first);
+			list.push_back(item.second);
+			pack(list.back());
+		}
+
+		return executeBatch(head, list, 2, NULL);
 	}
-	int range(vector<string>& vec, const string& key, int start, int end)
+	// 获取哈希的全部字段，返回字段数量
+	int hgetall(const string& key, map<string, string>& data)
 	{
-		return execute(vec, "lrange", key, start, end);
+		Reply reply;
+
+		data.clear();
+
+		if (execute(reply, "hgetall", key) < 0) return code;
+
+		for (int i = 0; i + 1 < reply.size(); i += 2)
+		{
+			Reply::Item item = reply.at(i + 1);
+
+			string& val = data[reply.at(i).str()];
+
+			val.assign(item.data(), item.length());
+
+			if (unpack(val) < 0) return code;
+		}
+
+		return data.size();
 	}
-	int lrange(vector<string>& vec, const string& key, int start, int end)
+	// 将结构体的全部字段以一条HSET写入哈希，字符串字段与hset一样经过编码器压缩。
+	// visit是非const的模板函数(同一个visit也用于hgetObject写入字段)，所以obj不能是const对象
+	template<class OBJECT>
+	int hsetObject(const string& key, OBJECT& obj)
 	{
-		return execute(vec, "lrange", key, start, end);
-	}
+		Command cmd("hset");
+		FieldWriter writer(cmd, this);
 
-public:
-	int zrem(const string& key, const string& filed)
+		cmd.add(key);
+		obj.visit(writer);
+
+		return execute(cmd);
+	}
+	// 以一条HMGET读取结构体的全部字段，数值直接从应答中解析，字符串字段与hget一样经过编码器解压，
+	// 返回哈希中存在的字段数量
+	template<class OBJECT>
+	int hgetObject(const string& key, OBJECT& obj)
 	{
-		return execute("zrem", key, filed);
+		Command cmd("hmget");
+		FieldWriter names(cmd, NULL);
+
+		cmd.add(key);
+		obj.visit(names);
+
+		if (execute(cmd) < 0) return code;
+
+		FieldReader reader(cmd.getReply(), this);
+
+		obj.visit(reader);
+
+		return reader.isFailed() ? code : reader.count();
 	}
-	int zadd(const string& key, const string& filed, int score)
+	// 批量删除键值，返回删除的键数量
+	int del(const vector<string>& keys)
 	{
-		return execute("zadd", key, score, filed);
+		return count("del", keys);
 	}
-	int zrange(vector<string>& vec, const string& key, int start, int end, bool withscore = false)
+	// 批量异步删除键值(由服务端后台线程释放内存)，返回删除的键数量
+	int unlink(const vector<string>& keys)
 	{
-		return withscore ? execute(vec, "zrange", key, start, end, "withscores") : execute(vec, "zrange", key, start, end);
+		return count("unlink", keys);
 	}
 
 
@@ -841,7 +2273,7 @@ public:
 
 		cmd.getResult(this, timeout);
 	
-		if (code > 0) std::swap(vec, cmd.res);
+		if (code > 0) cmd.fetch(vec);
 
 		return code;
 	}
@@ -917,37 +2349,407 @@ public:
 	}
 
 protected:
-	virtual shared_ptr<RedisConnect> grasp() const
+	// 发送值长度为len的SET命令：由body发送命令头部、值和尾部(返回值小于0表示失败)，然后读取应答
+	int setValue(const string& key, size_t len, int timeout, const function<int(const string&, const string&)>& body)
 	{
-		static ResPool<RedisConnect> pool([&]() {
-			shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
-			// 如果创建好了redis对象 且 与服务器成功建立连接
-			if (redis && redis->connect(host, port, timeout, memsz))
-			{	
-				// 成功进行身份验证，则返回redis对象
-				if (redis->auth(passwd)) return redis;
-			}
-			// 否则返回NULL
-			return redis = NULL;
-		}, POOL_MAXLEN);
+		char tmp[64];
+		string head;
+		string tail("\r\n");
+		Command cmd("set");
+
+		head.append(tmp, snprintf(tmp, sizeof(tmp), "*%d\r\n$3\r\nset\r\n$%d\r\n", timeout > 0 ? 5 : 3, (int)(key.length())));
+		head.append(key);
+		head.append(tmp, snprintf(tmp, sizeof(tmp), "\r\n$%llu\r\n", (unsigned long long)(len)));
+
+		if (timeout > 0)
+		{
+			string val = to_string(timeout);
+
+			tail.append(tmp, snprintf(tmp, sizeof(tmp), "$2\r\nex\r\n$%d\r\n", (int)(val.length())));
+			tail.append(val);
+			tail.append("\r\n");
+		}
+
+		int res = body(head, tail);
+
+		if (res < 0)
+		{
+			sock.close();	// 命令只发送了一部分，连接不能继续使用
+			cmd.finish(code = res);
+
+			status = 0;
+			msg = cmd.msg;
+
+			return code;
+		}
+
+		if (recv(cmd, Socket::GetClock() + this->timeout) == TIMEOUT) skip++;
+
+		return code;
+	}
+	// 将未解析的数据移动到缓冲区开头后继续接收，返回接收的字节数，缓冲区已满返回PARAMERR，到达截止时间返回TIMEOUT
+	int fill(int64 deadline)
+	{
+		if (pos > 0)
+		{
+			memmove(buffer, buffer + pos, readed - pos);
+			readed -= pos;
+			pos = 0;
+		}
+
+		if (readed >= memsz) return PARAMERR;	// 单条应答超过缓冲区大小
+
+		int len = sock.read(buffer + readed, memsz - readed, false, deadline);
+
+		if (len < 0) return len;
+		if (len == 0) return TIMEOUT;	// 到达截止时间仍未收到完整应答
+
+		buffer[readed += len] = 0;
+
+		return len;
+	}
+	// 从缓冲区解析下一条应答，数据不完整时继续接收，先丢弃skip条应答。
+	// 返回解析结果，网络错误、协议错误或到达截止时间时返回对应的错误码
+	int read(Command& cmd, int64 deadline)
+	{
+		while (true)
+		{
+			while (pos < readed)
+			{
+				int num = 0;
+				int res = cmd.parse(buffer + pos, readed - pos, num);
+
+				if (num <= 0)
+				{
+					if (res != TIMEOUT) return res;	// 协议错误
+
+					break;
+				}
+
+				pos += num;
+
+				if (skip <= 0) return res;
+
+				skip--;	// 丢弃之前超时或落后命令的应答
+				cmd.reset();
+			}
+
+			int len = fill(deadline);
+
+			if (len < 0) return len;
+		}
+	}
+	// 流式读取一条字符串应答：内容随接收依次交给sink，缓冲区只保存当前的数据块。
+	// 不是字符串的应答(如错误)按普通方式解析到cmd，每次接收到数据后截止时间顺延timeout毫秒
+	int stream(Command& cmd, const function<bool(const char*, int)>& sink)
+	{
+		int64 deadline = Socket::GetClock() + timeout;
+		int len = skip;
+		char* end = NULL;
+
+		for (skip = 0; len > 0; len--)	// 先丢弃之前超时或落后命令的应答
+		{
+			Command tmp;
+			int res = read(tmp, deadline);
+
+			if (IsBrokenCode(res))
+			{
+				skip = len;
+
+				return res;
+			}
+		}
+
+		while ((end = (char*)(memchr(buffer + pos, '\n', readed - pos))) == NULL)
+		{
+			if ((len = fill(deadline)) < 0) return len;
+		}
+
+		if (buffer[pos] != '$') return read(cmd, deadline);
+
+		int64 remain = atoll(buffer + pos + 1);
+
+		pos = end - buffer + 1;
+
+		if (remain < 0) return NOTFOUND;
+
+		for (remain += 2; remain > 0; )	// 内容之后还有\r\n
+		{
+			if (pos >= readed)
+			{
+				deadline = Socket::GetClock() + timeout;
+
+				if ((len = fill(deadline)) < 0) return len;
+			}
+
+			int num = (int)(min<int64>(remain, readed - pos));
+			int body = (int)(min<int64>(num, remain - 2));
+
+			if (body > 0 && sink(buffer + pos, body) == false) return IOERR;
+
+			pos += num;
+			remain -= num;
+		}
+
+		return OK;
+	}
+	// 收集结构体字段名及字段值作为命令参数，redis为空时只收集字段名，否则字符串字段按其编码器压缩
+	class FieldWriter
+	{
+		Command& cmd;
+		RedisConnect* redis;
+
+	public:
+		FieldWriter(Command& cmd, RedisConnect* redis) : cmd(cmd), redis(redis)
+		{
+		}
+		void operator () (const char* name, const string& val)
+		{
+			cmd.add(name);
+
+			if (redis == NULL) return;
+
+			string tmp;
+			const string& data = redis->pack(val, tmp);
+
+			cmd.add(data);
+		}
+		template<class DATA_TYPE>
+		void operator () (const char* name, const DATA_TYPE& val)
+		{
+			cmd.add(name);
+
+			if (redis) cmd.add(val);
+		}
+	};
+	// 按字段顺序从HMGET应答中读取结构体字段，不存在的字段保持原值
+	class FieldReader
+	{
+		int idx = 0;
+		int num = 0;
+		bool failed = false;	// 有字符串字段解压失败
+		const Reply& reply;
+		RedisConnect* redis;
+
+		void assign(const Reply::Item& item, string& val)
+		{
+			val.assign(item.data(), item.length());
+
+			if (redis->unpack(val) < 0) failed = true;
+		}
+		template<class DATA_TYPE>
+		void assign(const Reply::Item& item, DATA_TYPE& val)
+		{
+			Assign(item, val);
+		}
+		static void Assign(const Reply::Item& item, bool& val)
+		{
+			val = item.asInt64() != 0;
+		}
+		template<class DATA_TYPE>
+		static typename enable_if<is_integral<DATA_TYPE>::value>::type Assign(const Reply::Item& item, DATA_TYPE& val)
+		{
+			val = (DATA_TYPE)(item.asInt64());
+		}
+		template<class DATA_TYPE>
+		static typename enable_if<is_floating_point<DATA_TYPE>::value>::type Assign(const Reply::Item& item, DATA_TYPE& val)
+		{
+			val = (DATA_TYPE)(item.asDouble());
+		}
+
+	public:
+		FieldReader(const Reply& reply, RedisConnect* redis) : reply(reply), redis(redis)
+		{
+		}
+		int count() const
+		{
+			return num;
+		}
+		bool isFailed() const
+		{
+			return failed;
+		}
+		template<class DATA_TYPE>
+		void operator () (const char* name, DATA_TYPE& val)
+		{
+			if (idx >= reply.size()) return;
+
+			Reply::Item item = reply.at(idx++);
+
+			if (item.isNil()) return;
+
+			assign(item, val);
+			num++;
+		}
+	};
+
+	// 按编码器压缩值，需要压缩时结果写入tmp并返回tmp，否则返回原始值
+	const string& pack(const string& val, string& tmp)
+	{
+		if (codec && codec->encode(val, tmp)) return tmp;
+
+		return val;
+	}
+	void pack(string& val)
+	{
+		string tmp;
+
+		if (codec && codec->encode(val, tmp)) std::swap(val, tmp);
+	}
+	// 解压读取到的值，值损坏时返回DATAERR
+	int unpack(string& val)
+	{
+		if (codec && codec->decode(val) < 0)
+		{
+			msg = "codec error";
+
+			return code = DATAERR;
+		}
 
-		// 从资源池中获取可用的RedisConnect对象
-		shared_ptr<RedisConnect> redis = pool.get();
+		return code;
+	}
+
+	// 将list拆分为多批执行"head + 列表片段"形式的命令，step为每个逻辑元素占用的参数个数，
+	// 每批不超过BATCH_MAXLEN个元素且参数总长度不超过应答缓冲区大小，应答超过缓冲区时重连并将该批减半重试，
+	// 应答连同该批首个元素的下标交给func处理
+	int executeBatch(const vector<string>& head, const vector<string>& list, int step, function<void(const Reply&, int)> func)
+	{
+		Reply reply;
+		int idx = 0;
+		int maxlen = BATCH_MAXLEN;	// 每批的元素数量上限，应答超过缓冲区时减半
+		int len = list.size() / step;
 
-		// 若对象存在 且 存在错误
-		if (redis && redis->getErrorCode())
+		while (idx < len)
 		{
-			pool.disable(redis); // 将对象置为不可用状态
+			Command cmd;
+			int start = idx;
+			size_t bytes = 0;
+
+			for (const string& item : head) cmd.add(item);
+
+			while (idx < len && idx - start < maxlen && (bytes < (size_t)(memsz) || idx == start))
+			{
+				for (int i = 0; i < step; i++)
+				{
+					const string& item = list[idx * step + i];
+
+					bytes += item.length();
+					cmd.add(item);
+				}
+
+				idx++;
+			}
+
+			std::swap(reply, cmd.reply);
+
+			cmd.getResult(this, timeout);
+
+			std::swap(reply, cmd.reply);
+
+			// 应答超过缓冲区大小(如MGET的值较大)：连接已不能继续使用，重连后以一半的元素重新执行该批
+			if (code == PARAMERR && idx - start > 1)
+			{
+				if (reconnect() == false) return code = NETERR;
+
+				maxlen = (idx - start) / 2;
+				idx = start;
+
+				continue;
+			}
+
+			if (code < 0) return code;
+
+			if (func) func(reply, start);
+		}
+
+		return OK;
+	}
+	int count(const string& name, const vector<string>& keys)
+	{
+		int num = 0;
+		vector<string> head(1, name);
+
+		int res = executeBatch(head, keys, 1, [&](const Reply& reply, int) {
+			num += (int)(reply.asInt64());
+		});
+
+		return res < 0 ? res : num;
+	}
+
+protected:
+	// 复制连接配置(不复制连接本身)
+	void assign(const RedisConnect& tmpl)
+	{
+		db = tmpl.db;
+		host = tmpl.host;
+		port = tmpl.port;
+		memsz = tmpl.memsz;
+		codec = tmpl.codec;
+		passwd = tmpl.passwd;
+		timeout = tmpl.timeout;
+	}
+	// 保护默认连接的配置：Setup、SetCodec修改配置，建立连接时在锁内复制一份
+	static mutex& GetMutex()
+	{
+		static mutex mtx;
+		return mtx;
+	}
+	static void LoadTemplate(RedisConnect& tmpl)
+	{
+		lock_guard<mutex> lk(GetMutex());
 
-			return grasp();// 递归调用 grasp() 函数重新获取对象
+		tmpl.assign(*GetTemplate());
+	}
+	// 按tmpl的连接配置建立一个独立连接(已完成验证)，失败返回NULL
+	static shared_ptr<RedisConnect> NewConnect(const RedisConnect& tmpl)
+	{
+		shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
+		// 如果创建好了redis对象 且 与服务器成功建立连接
+		if (redis && redis->connect(tmpl.host, tmpl.port, tmpl.timeout, tmpl.memsz))
+		{	
+			// 成功进行身份验证并选择数据库，则返回redis对象
+			redis->codec = tmpl.codec;
+
+			if (redis->auth(tmpl.passwd) > 0 && redis->select(tmpl.db) > 0) return redis;
 		}
+		// 否则返回NULL
+		return redis = NULL;
+	}
+	static Service& GetService()
+	{
+		static Service service([]() {
+			return Create();
+		}, POOL_MAXLEN);
 
-		return redis;
+		return service;
+	}
+	static ResPool<RedisConnect>& GetPool()
+	{
+		return GetService().pool;
+	}
+	static CircuitBreaker& GetBreaker()
+	{
+		return GetService().breaker;
+	}
+	virtual shared_ptr<RedisConnect> grasp(int priority = ResPool<RedisConnect>::NORMAL, int wait = 3000) const
+	{
+		return GetService().grasp(priority, wait);
 	}
 
 public:
+	// 按Setup的配置建立一个不属于连接池的独立连接(已完成验证)，失败返回NULL
+	static shared_ptr<RedisConnect> Create()
+	{
+		RedisConnect tmpl;
+
+		LoadTemplate(tmpl);
+
+		return NewConnect(tmpl);
+	}
 	static bool CanUse()
 	{
+		lock_guard<mutex> lk(GetMutex());
+
 		return GetTemplate()->port > 0;
 	}
 	static RedisConnect* GetTemplate()
@@ -955,34 +2757,154 @@ public:
 		static RedisConnect redis;
 		return &redis;
 	}
+	// 设置连接池的固定容量(关闭自适应)，缩小时只释放多余的空闲连接
 	static void SetMaxConnCount(int maxlen)
 	{
-		if (maxlen > 0) POOL_MAXLEN = maxlen;
+		if (maxlen <= 0) return;
+
+		POOL_MAXLEN = maxlen;
+
+		GetPool().setLength(maxlen);
+	}
+	// 连接池容量在minlen和maxlen之间自适应：获取连接需要等待时立即扩容，
+	// 每interval毫秒按同时使用连接数的峰值(保留25%余量)扩容或逐步缩容，缩容只释放空闲连接
+	static void SetPoolRange(int minlen, int maxlen, int interval = 1000)
+	{
+		if (maxlen <= 0) return;
+
+		POOL_MAXLEN = maxlen;
+
+		GetPool().setAdaptive(minlen, maxlen, interval);
+	}
+	// 连接池的容量、使用量、等待和扩缩容统计
+	static ResPool<RedisConnect>::Stat GetPoolStat()
+	{
+		return GetPool().getStat();
+	}
+	// 设置连接池中连接使用的值压缩编码器(如make_shared<LZCodec>())，需在获取连接之前设置
+	static void SetCodec(shared_ptr<RedisCodec> codec)
+	{
+		lock_guard<mutex> lk(GetMutex());
+
+		GetTemplate()->codec = codec;
+	}
+	// 预热连接池：并发建立连接并放入连接池，count小于等于0时补足到连接池的当前容量，返回新增的连接数量
+	static int Warmup(int count = 0)
+	{
+		RedisConnect tmpl;
+		ResPool<RedisConnect>& pool = GetPool();
+		vector<shared_ptr<RedisConnect>> vec;
+
+		if (count <= 0) count = pool.getLimit() - pool.size();
+
+		if (count <= 0) return 0;
+
+		int64 gen = pool.getEpoch();	// 先于复制配置取得，建立连接期间Setup改变配置时丢弃这批连接
+
+		LoadTemplate(tmpl);
+
+		if (tmpl.spawn(vec, count) <= 0) return 0;
+
+		return pool.put(vec, gen);
+	}
+	// 开启后每个线程首次获取的连接缓存在线程局部变量中，之后同一线程直接复用而不再访问连接池，
+	// 只有连接损坏时才重新从连接池获取。使用限制：
+	// 1、同一线程中嵌套获取得到的是同一个连接，持有WATCH/MULTI、订阅、阻塞命令或分页迭代中的连接时，
+	//    同一线程的其它代码不能再通过Instance获取连接，否则会在该连接上执行无关的命令；
+	// 2、缓存的连接在线程退出前一直占用，使用连接的线程数量超过连接池上限时其它线程将无法获取连接；
+	// 3、缓存的连接忽略PriorityInstance的优先级，只有首次获取时按优先级调度。
+	// Setup改变服务地址、密码或数据库后，各线程在下一次获取时丢弃缓存的连接并按新的配置重新获取
+	static void SetThreadCache(bool flag)
+	{
+		THREAD_CACHE = flag;
+	}
+	// 开启后收发数据时等待和读写在一次io_uring_enter中完成，需在编译时定义XG_URING，内核不支持时返回false
+	static bool SetUring(bool flag)
+	{
+#ifdef XG_URING
+		if (flag && RedisUring::Local() == NULL) return false;
+
+		URING = flag;
+
+		return true;
+#else
+		return flag == false;
+#endif
+	}
+	// 连续threshold次连接失败后熔断，期间获取连接立即返回NULL，后台从mindelay毫秒开始按指数退避探测，最长间隔maxdelay毫秒
+	static void SetCircuit(int threshold, int mindelay = 100, int maxdelay = 5000)
+	{
+		GetBreaker().setThreshold(threshold, mindelay, maxdelay);
+	}
+	static CircuitBreaker::Stat GetCircuitStat()
+	{
+		return GetBreaker().getStat();
+	}
+	// 连接池的优先级调度：reserve个连接只供高优先级使用，连接池已满时各优先级按权重high:normal:low轮流获取归还的连接
+	static void SetQos(int reserve, int high = 8, int normal = 4, int low = 1)
+	{
+		GetPool().setQos(reserve, high, normal, low);
 	}
 	static shared_ptr<RedisConnect> Instance()
+	{
+		return PriorityInstance(ResPool<RedisConnect>::NORMAL);
+	}
+	// 按优先级获取连接(ResPool<RedisConnect>::HIGH/NORMAL/LOW)，如用户请求使用HIGH，批量任务使用LOW
+	static shared_ptr<RedisConnect> PriorityInstance(int priority)
 	{	
+		if (THREAD_CACHE)
+		{
+			thread_local int64 epoch = 0;
+			thread_local shared_ptr<RedisConnect> redis;
+			int64 current = GetPool().getEpoch();
+
+			if (redis && redis->isBroken() == false && epoch == current) return redis;
+
+			if (redis && epoch == current) GetPool().disable(redis);	// Setup改变配置后旧连接已不在连接池中
+
+			epoch = current;
+
+			return redis = GetTemplate()->grasp(priority);
+		}
+
 		// GetTemplate()的返回值是一个RedisConnect类型的指针，所以可以用->调用grasp()
-		return GetTemplate()->grasp();
+		return GetTemplate()->grasp(priority);
 	}
-	static void Setup(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024)
+	// 进程级的网络初始化，Setup(及命名端点的Setup)中自动调用
+	static void Startup()
 	{
 #ifdef XG_LINUX
 		signal(SIGPIPE, SIG_IGN); // ignore SIGPIPE
 #else
 		WSADATA data; WSAStartup(MAKEWORD(2, 2), &data);
 #endif
+	}
+	// 设置默认连接的配置，服务地址、密码或数据库改变时丢弃连接池中原有的连接(已取得的连接不受影响)。
+	// 先更新配置再清空连接池，之后建立的连接都使用新的配置。需要同时访问多个服务时使用RedisEndpoint按名称配置
+	static void Setup(const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024, int db = 0)
+	{
+		Startup();
+
 		RedisConnect* redis = GetTemplate();
+		lock_guard<mutex> lk(GetMutex());
+		bool changed = redis->port > 0 && (redis->host != host || redis->port != port || redis->passwd != passwd || redis->db != db);
 
+		redis->db = db;
 		redis->host = host;
 		redis->port = port;
 		redis->memsz = memsz;
 		redis->passwd = passwd;
 		redis->timeout = timeout;
+
+		if (changed) GetPool().clear();
 	}
 };
 
 int RedisConnect::POOL_MAXLEN = 8;
+int RedisConnect::BATCH_MAXLEN = 512;
 int RedisConnect::SOCKET_TIMEOUT = 10;
+atomic<bool> RedisConnect::THREAD_CACHE(false);
+bool RedisConnect::URING = false;
 	
 ///////////////////////////////////////////////////////////////
 #endif
\ No newline at end of file
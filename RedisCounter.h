@@ -0,0 +1,308 @@
+#ifndef XG_REDISCOUNTER_H
+#define XG_REDISCOUNTER_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+// 本地聚合计数器：incr/hincr只在进程内累加增量，后台线程按时间间隔或累积的键数量，
+// 将所有增量合并为一次流水线批量INCRBY/HINCRBY发送，析构时保证发送剩余的增量。
+// 增量按调用线程分散到多个分段中，每个线程固定使用一个分段，分段锁几乎没有竞争
+class RedisCounter
+{
+	typedef RedisConnect::Command Command;
+	typedef function<shared_ptr<RedisConnect>()> Creator;
+
+	static const int STRIPE_COUNT = 16;
+
+public:
+	struct Stat
+	{
+		int64 addCount;	// incr/hincr调用次数
+		int64 flushCount;	// 发送批次数
+		int64 commandCount;	// 发送成功的INCRBY/HINCRBY命令数
+		int64 failCount;	// 发送失败的命令数
+	};
+
+protected:
+	struct Stripe
+	{
+		mutex mtx;
+		unordered_map<string, int64> incrs;
+		unordered_map<string, unordered_map<string, int64>> hincrs;
+	};
+
+	mutex mtx;
+	mutex flushMtx;	// 串行化后台线程与主动调用的flush
+	bool stop = false;
+	int interval;
+	int maxsize;
+	thread worker;
+	Creator creator;
+	atomic<int> pending;	// 待发送的不同键(字段)数量
+	atomic<int64> addCount;
+	atomic<int64> flushCount;
+	atomic<int64> commandCount;
+	atomic<int64> failCount;
+	condition_variable cv;
+	Stripe stripes[STRIPE_COUNT];
+
+	// 当前线程使用的分段，线程首次调用时轮流分配
+	Stripe& getStripe()
+	{
+		static atomic<int> seq(0);
+		thread_local int idx = seq++ % STRIPE_COUNT;
+
+		return stripes[idx];
+	}
+	void added(bool created)
+	{
+		addCount++;
+
+		if (created && ++pending >= maxsize)
+		{
+			lock_guard<mutex> lk(mtx);
+
+			cv.notify_one();
+		}
+	}
+	void run()
+	{
+		unique_lock<mutex> lk(mtx);
+
+		while (stop == false)
+		{
+			cv.wait_for(lk, chrono::milliseconds(interval), [&]() {
+				return stop || pending >= maxsize;
+			});
+
+			if (stop) break;
+
+			lk.unlock();
+			flush();
+			lk.lock();
+		}
+	}
+	// 取出所有分段中的增量，合并后放入incrs和hincrs
+	void take(unordered_map<string, int64>& incrs, unordered_map<string, unordered_map<string, int64>>& hincrs)
+	{
+		for (Stripe& stripe : stripes)
+		{
+			unordered_map<string, int64> tmp;
+			unordered_map<string, unordered_map<string, int64>> htmp;
+
+			{
+				lock_guard<mutex> lk(stripe.mtx);
+
+				tmp.swap(stripe.incrs);
+				htmp.swap(stripe.hincrs);
+			}
+
+			for (auto& item : tmp) incrs[item.first] += item.second;
+
+			for (auto& item : htmp)
+			{
+				unordered_map<string, int64>& dest = hincrs[item.first];
+
+				for (auto& field : item.second) dest[field.first] += field.second;
+			}
+		}
+	}
+
+public:
+	// 每interval毫秒发送一次，待发送的键数量达到maxsize时提前发送，creator提供发送使用的连接
+	RedisCounter(int interval = 1000, int maxsize = 10000, Creator creator = RedisConnect::Instance) : interval(max(1, interval)), maxsize(max(1, maxsize)), creator(creator)
+	{
+		pending = 0;
+		addCount = flushCount = commandCount = failCount = 0;
+
+		worker = thread(&RedisCounter::run, this);
+	}
+	~RedisCounter()
+	{
+		{
+			lock_guard<mutex> lk(mtx);
+
+			stop = true;
+			cv.notify_all();
+		}
+
+		if (worker.joinable()) worker.join();
+
+		flush();
+	}
+	// 累加键值的增量
+	void incr(const string& key, int64 val = 1)
+	{
+		bool created = false;
+		Stripe& stripe = getStripe();
+
+		{
+			lock_guard<mutex> lk(stripe.mtx);
+			auto res = stripe.incrs.insert(pair<string, int64>(key, val));
+
+			if (res.second)
+			{
+				created = true;
+			}
+			else
+			{
+				res.first->second += val;
+			}
+		}
+
+		added(created);
+	}
+	// 累加哈希字段的增量
+	void hincr(const string& key, const string& field, int64 val = 1)
+	{
+		bool created = false;
+		Stripe& stripe = getStripe();
+
+		{
+			lock_guard<mutex> lk(stripe.mtx);
+			auto res = stripe.hincrs[key].insert(pair<string, int64>(field, val));
+
+			if (res.second)
+			{
+				created = true;
+			}
+			else
+			{
+				res.first->second += val;
+			}
+		}
+
+		added(created);
+	}
+	// 立即发送所有增量，返回发送成功的命令数量。没有收到应答的增量放回本地下次重新发送，
+	// 如果服务端已经执行但应答丢失，这部分增量会被重复累加；服务端返回错误(如类型不匹配)的增量直接丢弃
+	int flush()
+	{
+		lock_guard<mutex> lk(flushMtx);
+		unordered_map<string, int64> incrs;
+		unordered_map<string, unordered_map<string, int64>> hincrs;
+
+		pending = 0;
+
+		take(incrs, hincrs);
+
+		vector<Command> cmds;
+
+		cmds.reserve(incrs.size() + hincrs.size());
+
+		for (auto& item : incrs)
+		{
+			if (item.second == 0) continue;
+
+			cmds.push_back(Command("incrby"));
+			cmds.back().add(item.first, item.second);
+		}
+
+		for (auto& item : hincrs)
+		{
+			for (auto& field : item.second)
+			{
+				if (field.second == 0) continue;
+
+				cmds.push_back(Command("hincrby"));
+				cmds.back().add(item.first, field.first, field.second);
+			}
+		}
+
+		if (cmds.empty()) return 0;
+
+		size_t idx = 0;
+		shared_ptr<RedisConnect> redis = creator();
+
+		while (redis && idx < cmds.size())
+		{
+			vector<Command*> ptrs;
+			size_t end = min(cmds.size(), idx + RedisConnect::BATCH_MAXLEN);
+
+			while (idx < end) ptrs.push_back(&cmds[idx++]);
+
+			flushCount++;
+
+			if (redis->pipeline(ptrs, redis->getTimeout()) < 0) break;
+		}
+
+		int num = 0;
+		int again = 0;
+
+		idx = 0;
+
+		for (auto& item : incrs)
+		{
+			if (item.second == 0) continue;
+
+			int code = cmds[idx++].getCode();
+
+			if (code > 0)
+			{
+				num++;
+			}
+			else
+			{
+				failCount++;
+
+				if (code == 0 || RedisConnect::IsBrokenCode(code))
+				{
+					incr(item.first, item.second);
+					again++;
+				}
+			}
+		}
+
+		for (auto& item : hincrs)
+		{
+			for (auto& field : item.second)
+			{
+				if (field.second == 0) continue;
+
+				int code = cmds[idx++].getCode();
+
+				if (code > 0)
+				{
+					num++;
+				}
+				else
+				{
+					failCount++;
+
+					if (code == 0 || RedisConnect::IsBrokenCode(code))
+					{
+						hincr(item.first, field.first, field.second);
+						again++;
+					}
+				}
+			}
+		}
+
+		commandCount += num;
+		addCount -= again;	// 放回的增量不计入调用次数
+
+		return num;
+	}
+	Stat getStat() const
+	{
+		Stat stat;
+
+		stat.addCount = addCount;
+		stat.flushCount = flushCount;
+		stat.commandCount = commandCount;
+		stat.failCount = failCount;
+
+		return stat;
+	}
+	// 待发送的不同键(字段)数量
+	int size() const
+	{
+		return pending;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,245 @@
+#ifndef XG_REDISENDPOINT_H
+#define XG_REDISENDPOINT_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <map>
+#include <atomic>
+
+// 命名端点：同一进程中按名称配置多个Redis服务(如缓存、会话、队列)，每个端点有独立的连接配置、
+// 连接池和熔断器，容量和超时互不影响，批量队列流量不会占用缓存读取的连接。
+// 端点表写时复制，获取连接时不加锁；重新Setup同名端点时新建连接池，旧连接在使用方释放后自然回收
+class RedisEndpoint
+{
+public:
+	typedef ResPool<RedisConnect>::Stat PoolStat;
+	typedef CircuitBreaker::Stat CircuitStat;
+
+protected:
+	struct Endpoint
+	{
+		mutex mtx;	// 保护连接配置，值编码器在端点使用期间也可以修改
+		string name;
+		RedisConnect tmpl;	// 连接配置(与RedisConnect::GetTemplate的作用相同)
+		RedisConnect::Service service;
+
+		Endpoint() : service([this]() { return Create(this); }, RedisConnect::POOL_MAXLEN)
+		{
+		}
+	};
+
+	typedef map<string, shared_ptr<Endpoint>> Table;
+
+	static mutex& GetMutex()
+	{
+		static mutex mtx;	// 串行化端点的增删，读取端点表不加锁
+		return mtx;
+	}
+	static shared_ptr<Table>& GetTable()
+	{
+		static shared_ptr<Table> table = make_shared<Table>();
+		return table;
+	}
+	static shared_ptr<Endpoint> Find(const string& name)
+	{
+		shared_ptr<Table> table = atomic_load(&GetTable());
+		auto it = table->find(name);
+
+		return it == table->end() ? NULL : it->second;
+	}
+	static void LoadTemplate(Endpoint* endpoint, RedisConnect& tmpl)
+	{
+		lock_guard<mutex> lk(endpoint->mtx);
+
+		tmpl.assign(endpoint->tmpl);
+	}
+	static shared_ptr<RedisConnect> Create(Endpoint* endpoint)
+	{
+		RedisConnect tmpl;
+
+		LoadTemplate(endpoint, tmpl);
+
+		return RedisConnect::NewConnect(tmpl);
+	}
+
+public:
+	// 添加或替换名为name的端点，参数与RedisConnect::Setup相同。配置不变时保留原有的连接池，配置改变时
+	// 新建连接池(连接池容量、优先级调度、熔断参数和值编码器沿用原端点)，之后获取的连接都指向新的服务
+	static void Setup(const string& name, const string& host, int port, const string& passwd = "", int timeout = 3000, int memsz = 2 * 1024 * 1024, int db = 0)
+	{
+		RedisConnect::Startup();
+
+		lock_guard<mutex> lk(GetMutex());
+		shared_ptr<Table> table = make_shared<Table>(*atomic_load(&GetTable()));
+		shared_ptr<Endpoint>& item = (*table)[name];
+
+		if (item)
+		{
+			const RedisConnect& tmpl = item->tmpl;
+
+			if (tmpl.host == host && tmpl.port == port && tmpl.passwd == passwd && tmpl.timeout == timeout && tmpl.memsz == memsz && tmpl.db == db) return;
+		}
+
+		shared_ptr<Endpoint> endpoint = make_shared<Endpoint>();
+
+		endpoint->name = name;
+		endpoint->tmpl.db = db;
+		endpoint->tmpl.host = host;
+		endpoint->tmpl.port = port;
+		endpoint->tmpl.memsz = memsz;
+		endpoint->tmpl.passwd = passwd;
+		endpoint->tmpl.timeout = timeout;
+
+		if (item)
+		{
+			lock_guard<mutex> lk(item->mtx);
+
+			endpoint->tmpl.codec = item->tmpl.codec;
+			endpoint->service.inherit(item->service);
+		}
+
+		item = endpoint;
+
+		atomic_store(&GetTable(), table);
+	}
+	// 移除端点，已经取得的连接仍可继续使用直到释放
+	static bool Remove(const string& name)
+	{
+		lock_guard<mutex> lk(GetMutex());
+		shared_ptr<Table> table = make_shared<Table>(*atomic_load(&GetTable()));
+
+		if (table->erase(name) == 0) return false;
+
+		atomic_store(&GetTable(), table);
+
+		return true;
+	}
+	static bool CanUse(const string& name)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		return endpoint && endpoint->tmpl.port > 0;
+	}
+	static vector<string> GetNames()
+	{
+		vector<string> vec;
+		shared_ptr<Table> table = atomic_load(&GetTable());
+
+		for (auto& item : *table) vec.push_back(item.first);
+
+		return vec;
+	}
+	// 按优先级从端点的连接池获取连接，端点不存在、熔断或无法连接时返回NULL
+	static shared_ptr<RedisConnect> Instance(const string& name, int priority = ResPool<RedisConnect>::NORMAL)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		return endpoint ? endpoint->service.grasp(priority) : NULL;
+	}
+	// 按端点的配置建立一个不属于连接池的独立连接(已完成验证)，失败返回NULL
+	static shared_ptr<RedisConnect> Create(const string& name)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		return endpoint ? Create(endpoint.get()) : NULL;
+	}
+	// 设置端点连接池的固定容量(关闭自适应)
+	static bool SetMaxConnCount(const string& name, int maxlen)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint || maxlen <= 0) return false;
+
+		endpoint->service.pool.setLength(maxlen);
+
+		return true;
+	}
+	// 端点连接池的容量在minlen和maxlen之间自适应，含义与RedisConnect::SetPoolRange相同
+	static bool SetPoolRange(const string& name, int minlen, int maxlen, int interval = 1000)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint || maxlen <= 0) return false;
+
+		endpoint->service.pool.setAdaptive(minlen, maxlen, interval);
+
+		return true;
+	}
+	// 设置端点连接使用的值压缩编码器，需在获取连接之前设置
+	static bool SetCodec(const string& name, shared_ptr<RedisCodec> codec)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint) return false;
+
+		lock_guard<mutex> lk(endpoint->mtx);
+
+		endpoint->tmpl.codec = codec;
+
+		return true;
+	}
+	// 端点连接池的优先级调度，含义与RedisConnect::SetQos相同
+	static bool SetQos(const string& name, int reserve, int high = 8, int normal = 4, int low = 1)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint) return false;
+
+		endpoint->service.pool.setQos(reserve, high, normal, low);
+
+		return true;
+	}
+	static bool SetCircuit(const string& name, int threshold, int mindelay = 100, int maxdelay = 5000)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint) return false;
+
+		endpoint->service.breaker.setThreshold(threshold, mindelay, maxdelay);
+
+		return true;
+	}
+	// 预热端点的连接池，count小于等于0时补足到连接池的当前容量，返回新增的连接数量
+	static int Warmup(const string& name, int count = 0)
+	{
+		RedisConnect tmpl;
+		shared_ptr<Endpoint> endpoint = Find(name);
+		vector<shared_ptr<RedisConnect>> vec;
+
+		if (!endpoint) return 0;
+
+		if (count <= 0) count = endpoint->service.pool.getLimit() - endpoint->service.pool.size();
+
+		if (count <= 0) return 0;
+
+		int64 gen = endpoint->service.pool.getEpoch();
+
+		LoadTemplate(endpoint.get(), tmpl);
+
+		if (tmpl.spawn(vec, count) <= 0) return 0;
+
+		return endpoint->service.pool.put(vec, gen);
+	}
+	static bool GetPoolStat(const string& name, PoolStat& stat)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint) return false;
+
+		stat = endpoint->service.pool.getStat();
+
+		return true;
+	}
+	static bool GetCircuitStat(const string& name, CircuitStat& stat)
+	{
+		shared_ptr<Endpoint> endpoint = Find(name);
+
+		if (!endpoint) return false;
+
+		stat = endpoint->service.breaker.getStat();
+
+		return true;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,262 @@
+#ifndef XG_REDISHEDGE_H
+#define XG_REDISHEDGE_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <set>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+
+// 对冲读：只读命令在主连接上超过延迟分位数仍未返回时，在第二个连接(连接池或副本)上发送同一命令，
+// 采用先到达的应答。落后一方的应答不会等待，由该连接下一次执行命令时丢弃
+class RedisHedge
+{
+	typedef RedisConnect::Socket Socket;
+	typedef RedisConnect::Command Command;
+	typedef function<shared_ptr<RedisConnect>()> Creator;
+
+	static const int SAMPLE_COUNT = 1024;	// 统计延迟的样本窗口大小
+	static const int UPDATE_COUNT = 64;	// 每收集若干样本重新计算一次对冲延迟
+
+public:
+	struct Stat
+	{
+		int delay;	// 当前的对冲延迟(毫秒)
+		int64 total;	// 只读命令总数
+		int64 hedgeCount;	// 发出对冲请求的次数
+		int64 backupWins;	// 对冲请求先返回的次数
+	};
+
+protected:
+	mutex mtx;
+	int maxdelay;
+	int mindelay;
+	double percentile;
+	Creator backup;
+	atomic<int> delay;
+	atomic<int64> total;
+	atomic<int64> hedgeCount;
+	atomic<int64> backupWins;
+
+	size_t cursor = 0;
+	vector<int> samples;	// 最近的延迟样本(环形)
+	set<string> readonly;	// 允许对冲的只读命令(小写)
+
+	void record(int cost)
+	{
+		unique_lock<mutex> lk(mtx, try_to_lock);
+
+		if (lk.owns_lock() == false) return;	// 竞争激烈时丢弃样本，不阻塞调用线程
+
+		if (samples.size() < SAMPLE_COUNT)
+		{
+			samples.push_back(cost);
+		}
+		else
+		{
+			samples[cursor % SAMPLE_COUNT] = cost;
+		}
+
+		if (++cursor % UPDATE_COUNT) return;
+
+		vector<int> vec = samples;
+		size_t idx = (size_t)(percentile * (vec.size() - 1));
+
+		nth_element(vec.begin(), vec.begin() + idx, vec.end());
+
+		delay = max(mindelay, min(maxdelay, vec[idx]));
+	}
+	// 命令完成：结果同步到执行命令的连接上
+	static int Finish(RedisConnect& redis, Command& cmd)
+	{
+		redis.code = cmd.code;
+		redis.status = cmd.status;
+		redis.msg = cmd.msg;
+
+		return redis.code;
+	}
+
+public:
+	// percentile为对冲延迟取的延迟分位数，对冲延迟限制在[mindelay, maxdelay]毫秒之间，
+	// backup返回用于对冲的第二个连接(如指向副本的连接)，应当立即返回，没有空闲连接时返回NULL；
+	// 默认从连接池获取，连接池已满时不等待，直接放弃对冲
+	RedisHedge(double percentile = 0.95, int mindelay = 1, int maxdelay = 100, Creator backup = NULL) : maxdelay(maxdelay), mindelay(mindelay), percentile(percentile), backup(backup)
+	{
+		const char* cmds[] = {
+			"get", "mget", "getrange", "strlen", "exists", "type", "ttl", "pttl",
+			"hget", "hmget", "hgetall", "hkeys", "hvals", "hlen", "hexists", "hstrlen",
+			"lindex", "llen", "lrange",
+			"scard", "smembers", "sismember", "smismember", "srandmember",
+			"zcard", "zcount", "zscore", "zmscore", "zrank", "zrevrank",
+			"zrange", "zrevrange", "zrangebyscore", "zrevrangebyscore", "zrangebylex", "zlexcount",
+			"getbit", "bitcount", "pfcount", "xlen", "xrange", "xrevrange"
+		};
+
+		for (const char* cmd : cmds) readonly.insert(cmd);
+
+		delay = maxdelay;
+		total = hedgeCount = backupWins = 0;
+	}
+	// 将命令加入(或移出)允许对冲的命令列表，只有幂等的读命令才能对冲
+	void setReadOnly(const string& name, bool flag = true)
+	{
+		string key = name;
+
+		transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+		if (flag)
+		{
+			readonly.insert(key);
+		}
+		else
+		{
+			readonly.erase(key);
+		}
+	}
+	bool isReadOnly(const Command& cmd) const
+	{
+		if (cmd.vec.empty()) return false;
+
+		string key = cmd.vec[0];
+
+		transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+		return readonly.find(key) != readonly.end();
+	}
+	Stat getStat() const
+	{
+		Stat stat;
+
+		stat.delay = delay;
+		stat.total = total;
+		stat.hedgeCount = hedgeCount;
+		stat.backupWins = backupWins;
+
+		return stat;
+	}
+	// 在redis上执行命令，只读命令超过对冲延迟未返回时在第二个连接上再次发送，
+	// timeout小于等于0时使用连接的默认超时时间，返回值与RedisConnect::execute相同
+	int execute(RedisConnect& redis, Command& cmd, int timeout = 0)
+	{
+		if (timeout <= 0) timeout = redis.timeout;
+
+		if (isReadOnly(cmd) == false) return redis.execute(cmd, timeout);
+
+		total++;
+
+		const int64 stime = Socket::GetClock();
+		const int64 deadline = stime + timeout;
+		const int64 hedgetime = min(deadline, stime + delay);
+
+		if (redis.send(cmd, deadline) < 0) return redis.code;
+
+		int res = redis.recv(cmd, hedgetime);
+
+		if (res != RedisConnect::TIMEOUT || Socket::GetClock() >= deadline)
+		{
+			if (res == RedisConnect::TIMEOUT) redis.skip++;
+			else record((int)(Socket::GetClock() - stime));
+
+			return res;
+		}
+
+		// 对冲只在截止时间前有意义，不能等待连接池归还连接
+		shared_ptr<RedisConnect> other = backup ? backup() : RedisConnect::GetTemplate()->grasp(ResPool<RedisConnect>::NORMAL, 0);
+
+		if (!other || other.get() == &redis)	// 没有可用于对冲的连接，继续等待主连接
+		{
+			if ((res = redis.recv(cmd, deadline)) == RedisConnect::TIMEOUT) redis.skip++;
+			else record((int)(Socket::GetClock() - stime));
+
+			return res;
+		}
+
+		Command copy;
+
+		copy.vec = cmd.vec;
+
+		if (other->send(copy, deadline) < 0)
+		{
+			if ((res = redis.recv(cmd, deadline)) == RedisConnect::TIMEOUT) redis.skip++;
+
+			return res;
+		}
+
+		hedgeCount++;
+
+		RedisConnect* conns[] = {&redis, other.get()};
+		Command* cmds[] = {&cmd, &copy};
+		bool alive[] = {true, true};
+
+		while (true)
+		{
+			vector<bool> ready;
+			vector<SOCKET> socks;
+			int64 now = Socket::GetClock();
+
+			for (int i = 0; i < 2; i++)
+			{
+				if (alive[i] == false) continue;
+
+				// 截止时间为当前时间，只处理已到达的数据
+				res = conns[i]->recv(*cmds[i], now);
+
+				if (res == RedisConnect::TIMEOUT) continue;
+
+				if (RedisConnect::IsBrokenCode(res))	// 该连接已损坏，等待另一个连接
+				{
+					alive[i] = false;
+					conns[i]->sock.close();
+
+					continue;
+				}
+
+				conns[1 - i]->skip++;	// 落后一方的应答由其下一次执行命令时丢弃
+
+				if (i > 0)
+				{
+					std::swap(cmd, copy);
+					backupWins++;
+				}
+
+				record((int)(now - stime));
+
+				return Finish(redis, cmd);
+			}
+
+			for (int i = 0; i < 2; i++)
+			{
+				if (alive[i]) socks.push_back(conns[i]->sock.getHandle());
+			}
+
+			if (socks.empty() || now >= deadline) break;
+
+			Socket::SocketWaitAll(socks, vector<bool>(socks.size(), false), ready, deadline);
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (alive[i] && cmds[i]->code == RedisConnect::TIMEOUT) conns[i]->skip++;
+		}
+
+		return Finish(redis, cmd);	// 两个连接都失败时返回主连接的错误
+	}
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(RedisConnect& redis, RedisConnect::Reply& reply, DATA_TYPE val, ARGS ...args)
+	{
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		std::swap(reply, cmd.reply);
+
+		int res = execute(redis, cmd);
+
+		std::swap(reply, cmd.reply);
+
+		return res;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
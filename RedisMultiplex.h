@@ -0,0 +1,403 @@
+#ifndef XG_REDISMULTIPLEX_H
+#define XG_REDISMULTIPLEX_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <deque>
+#include <atomic>
+#include <condition_variable>
+
+// 多路复用连接：任意多个线程的命令共享少量服务端连接。每个连接由一个写线程和一个读线程服务，
+// 写线程把排队期间积累的命令合并为一次写入(自动批量发送)，读线程按发送顺序解析应答并交还给等待的调用线程。
+// 连接被所有调用方共享，只支持不改变连接状态的普通命令：事务(MULTI/WATCH)、SELECT、订阅、CLIENT和
+// 阻塞读取(BLPOP、XREAD BLOCK等)会影响其它调用方的命令，execute直接返回PARAMERR。
+// 单个应答超过连接缓冲区(memsz)时该连接被断开重连，同一连接上所有已发送的命令都返回NETERR
+class RedisMultiplex
+{
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Socket Socket;
+	typedef RedisConnect::Command Command;
+
+	struct Request
+	{
+		mutex mtx;
+		bool done = false;
+		string data;	// 已序列化的命令
+		Command* cmd = NULL;	// 调用方的命令对象，调用方等待超时后置为NULL
+		condition_variable cv;
+	};
+
+	struct Channel
+	{
+		mutex mtx;
+		thread reader;
+		thread writer;
+		bool parked = false;	// 读线程已停止使用连接(连接损坏后等待重连)
+		atomic<bool> broken{false};	// 连接已损坏，需要由写线程重连
+		condition_variable cv;
+		shared_ptr<RedisConnect> redis;
+		deque<shared_ptr<Request>> queue;	// 等待发送的命令
+		deque<shared_ptr<Request>> inflight;	// 已发送等待应答的命令
+	};
+
+protected:
+	atomic<bool> stop;
+	atomic<u_int> next;
+	atomic<int64> batchCount;
+	atomic<int64> commandCount;
+	vector<shared_ptr<Channel>> list;
+
+	static void Finish(const shared_ptr<Request>& req, int code)
+	{
+		lock_guard<mutex> lk(req->mtx);
+
+		if (req->done) return;
+
+		if (req->cmd) req->cmd->finish(code);
+
+		req->done = true;
+		req->cv.notify_all();
+	}
+	static void Finish(deque<shared_ptr<Request>>& queue, int code)
+	{
+		for (const shared_ptr<Request>& req : queue) Finish(req, code);
+
+		queue.clear();
+	}
+	// 读线程发现连接损坏：已发送的命令全部失败，然后等待写线程重连
+	void park(Channel* ch, unique_lock<mutex>& lk)
+	{
+		ch->broken = true;
+		ch->parked = true;
+		ch->redis->sock.shutdown();
+
+		Finish(ch->inflight, RedisConnect::NETERR);
+
+		ch->cv.notify_all();
+		ch->cv.wait(lk, [&]() {
+			return stop || ch->broken == false;
+		});
+
+		ch->parked = false;
+	}
+	void doWrite(Channel* ch)
+	{
+		string data;
+
+		while (true)
+		{
+			unique_lock<mutex> lk(ch->mtx);
+
+			ch->cv.wait(lk, [&]() {
+				return stop || ch->broken || ch->queue.size() > 0;
+			});
+
+			if (stop) break;
+
+			if (ch->broken)
+			{
+				// 等待读线程停止使用连接后重连
+				ch->cv.wait(lk, [&]() {
+					return stop || ch->parked;
+				});
+
+				if (stop) break;
+
+				lk.unlock();
+
+				bool res = ch->redis->reconnect();
+
+				lk.lock();
+
+				if (res)
+				{
+					ch->broken = false;
+					ch->cv.notify_all();
+				}
+				else
+				{
+					Finish(ch->queue, RedisConnect::NETERR);
+
+					ch->cv.wait_for(lk, chrono::milliseconds(100), [&]() {
+						return stop.load();
+					});
+				}
+
+				continue;
+			}
+
+			for (const shared_ptr<Request>& req : ch->queue)
+			{
+				data += req->data;
+				ch->inflight.push_back(req);	// 先加入应答队列再发送，保证读线程能按顺序对应
+			}
+
+			batchCount++;
+			commandCount += ch->queue.size();
+			ch->queue.clear();
+
+			lk.unlock();
+
+			RedisConnect* redis = ch->redis.get();
+
+			if (redis->sock.write(data.c_str(), data.length(), Socket::GetClock() + redis->timeout) < 0)
+			{
+				lk.lock();
+				ch->broken = true;
+				redis->sock.shutdown();	// 唤醒读线程
+				ch->cv.notify_all();
+			}
+
+			data.clear();
+		}
+	}
+	void doRead(Channel* ch)
+	{
+		int pos = 0;
+		int readed = 0;
+		Command scratch;	// 调用方已离开时用于解析并丢弃应答
+
+		while (stop == false)
+		{
+			bool broken = false;
+			RedisConnect* redis = ch->redis.get();
+
+			while (pos < readed)
+			{
+				int num = 0;
+				int res = 0;
+				shared_ptr<Request> req;
+
+				{
+					lock_guard<mutex> lk(ch->mtx);
+
+					if (ch->inflight.size() > 0) req = ch->inflight.front();
+				}
+
+				if (!req)	// 没有等待应答的命令却收到了数据
+				{
+					broken = true;
+
+					break;
+				}
+
+				{
+					lock_guard<mutex> lk(req->mtx);
+					Command* cmd = req->cmd ? req->cmd : &scratch;
+
+					res = cmd->parse(redis->buffer + pos, readed - pos, num);
+
+					if (num > 0)
+					{
+						cmd->finish(res);
+						req->done = true;
+						req->cv.notify_all();
+					}
+				}
+
+				if (num <= 0)
+				{
+					if (res != RedisConnect::TIMEOUT) broken = true;	// 协议错误
+
+					break;
+				}
+
+				pos += num;
+
+				lock_guard<mutex> lk(ch->mtx);
+
+				ch->inflight.pop_front();
+			}
+
+			if (pos > 0)	// 将未解析的数据移动到缓冲区开头
+			{
+				memmove(redis->buffer, redis->buffer + pos, readed - pos);
+				readed -= pos;
+				pos = 0;
+			}
+
+			if (broken == false && readed < redis->memsz)
+			{
+				int len = redis->sock.read(redis->buffer + readed, redis->memsz - readed, false, Socket::GetClock() + 1000);
+
+				if (len > 0)
+				{
+					redis->buffer[readed += len] = 0;
+
+					continue;
+				}
+
+				if (len == 0 && ch->broken == false) continue;
+			}
+
+			unique_lock<mutex> lk(ch->mtx);
+
+			park(ch, lk);
+
+			pos = readed = 0;
+		}
+	}
+	Channel* select()
+	{
+		int len = list.size();
+
+		if (len <= 0) return NULL;
+
+		u_int idx = next++;
+
+		for (int i = 0; i < len; i++)
+		{
+			Channel* ch = list[(idx + i) % len].get();
+
+			if (ch->broken == false) return ch;	// 优先选择可用的连接
+		}
+
+		return list[idx % len].get();
+	}
+
+public:
+	// 按RedisConnect::Setup的配置并发建立count个共享连接
+	bool init(int count = 2)
+	{
+		RedisConnect tmpl;
+		vector<shared_ptr<RedisConnect>> vec;
+
+		RedisConnect::LoadTemplate(tmpl);
+
+		if (tmpl.spawn(vec, count) <= 0) return false;
+
+		return init(vec);
+	}
+	// 接管已经建立并完成验证的连接，之后这些连接只能通过本对象使用
+	bool init(const vector<shared_ptr<RedisConnect>>& vec)
+	{
+		close();
+
+		stop = false;
+
+		for (const shared_ptr<RedisConnect>& redis : vec)
+		{
+			if (!redis || redis->isBroken()) continue;
+
+			shared_ptr<Channel> ch = make_shared<Channel>();
+
+			ch->redis = redis;
+			ch->reader = thread(&RedisMultiplex::doRead, this, ch.get());
+			ch->writer = thread(&RedisMultiplex::doWrite, this, ch.get());
+
+			list.push_back(ch);
+		}
+
+		return list.size() > 0;
+	}
+	void close()
+	{
+		stop = true;
+
+		for (shared_ptr<Channel>& ch : list)
+		{
+			lock_guard<mutex> lk(ch->mtx);
+
+			ch->redis->sock.shutdown();
+			ch->cv.notify_all();
+		}
+
+		for (shared_ptr<Channel>& ch : list)
+		{
+			if (ch->reader.joinable()) ch->reader.join();
+			if (ch->writer.joinable()) ch->writer.join();
+
+			Finish(ch->queue, RedisConnect::NETERR);
+			Finish(ch->inflight, RedisConnect::NETERR);
+
+			ch->redis->close();
+		}
+
+		list.clear();
+	}
+	// 线程安全地执行命令，timeout小于等于0时使用连接的默认超时时间，不支持的命令返回PARAMERR
+	int execute(Command& cmd, int timeout = 0)
+	{
+		Channel* ch = select();
+
+		cmd.reset();
+
+		if (cmd.isStateful())
+		{
+			cmd.finish(RedisConnect::PARAMERR);
+
+			return cmd.getCode();
+		}
+
+		if (ch == NULL)
+		{
+			cmd.finish(RedisConnect::NETERR);
+
+			return cmd.getCode();
+		}
+
+		shared_ptr<Request> req = make_shared<Request>();
+
+		req->cmd = &cmd;
+		req->data = cmd.toString();	// 在调用线程中完成序列化，写线程只需合并
+
+		if (timeout <= 0) timeout = ch->redis->timeout;
+
+		{
+			lock_guard<mutex> lk(ch->mtx);
+
+			ch->queue.push_back(req);
+			ch->cv.notify_all();
+		}
+
+		unique_lock<mutex> lk(req->mtx);
+
+		if (req->cv.wait_for(lk, chrono::milliseconds(timeout), [&]() { return req->done; })) return cmd.getCode();
+
+		req->cmd = NULL;	// 应答到达后由读线程丢弃
+
+		lk.unlock();
+
+		cmd.reset();
+		cmd.finish(RedisConnect::TIMEOUT);
+
+		return cmd.getCode();
+	}
+	template<class DATA_TYPE, class ...ARGS>
+	int execute(Reply& reply, DATA_TYPE val, ARGS ...args)
+	{
+		Command cmd;
+
+		cmd.add(val, args...);
+
+		int res = execute(cmd);
+
+		std::swap(reply, cmd.reply);
+
+		return res;
+	}
+	int size() const
+	{
+		return list.size();
+	}
+	// 平均每次写入合并的命令数量，反映自动批量发送的效果
+	double getBatchSize() const
+	{
+		int64 cnt = batchCount;
+
+		return cnt > 0 ? (double)(commandCount) / cnt : 0;
+	}
+	RedisMultiplex()
+	{
+		stop = false;
+		next = 0;
+		batchCount = 0;
+		commandCount = 0;
+	}
+	~RedisMultiplex()
+	{
+		close();
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
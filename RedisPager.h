@@ -0,0 +1,249 @@
+#ifndef XG_REDISPAGER_H
+#define XG_REDISPAGER_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// 大集合分页迭代：列表(LRANGE)、有序集合(ZRANGE)按下标，哈希、集合、有序集合按游标(HSCAN/SSCAN/ZSCAN)
+// 每次读取固定数量的元素，收到一页应答后先发送下一页的请求再把当前页交给调用方，服务端准备下一页与
+// 调用方处理当前页同时进行。内存占用只与页大小有关，第一页数据不需要等待整个集合读取完成。
+// 迭代期间连接由分页器独占，中途放弃时未读取的应答由连接的下一条命令丢弃。未指定连接时直接从连接池获取，
+// 开启线程缓存(SetThreadCache)时也不会与同一线程通过Instance取得的连接混用
+class RedisPager
+{
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Socket Socket;
+	typedef RedisConnect::Command Command;
+
+public:
+	static const int LRANGE = 0;	// 列表，元素类型为string
+	static const int ZRANGE = 1;	// 有序集合(按排名)，元素类型为Score
+	static const int HSCAN = 2;	// 哈希，元素类型为Field
+	static const int SSCAN = 3;	// 集合，元素类型为string
+	static const int ZSCAN = 4;	// 有序集合(无序遍历)，元素类型为Score
+
+	typedef pair<string, string> Field;	// 哈希的字段和值
+	typedef pair<string, double> Score;	// 有序集合的成员和分数
+
+protected:
+	int type;
+	int count;
+	int cur = 0;	// 正在等待应答的命令下标
+	bool sent = false;	// 是否有已发送但还未读取应答的请求
+	bool done = false;	// 已请求到最后一页
+	int64 end = -1;	// 按下标读取的结束位置(包含)，-1表示到末尾
+	int64 pos = 0;	// 按下标读取时下一页的起始位置
+	string key;
+	string cursor = "0";	// 按游标读取时下一页的游标
+	string pattern;
+	Command cmds[2];	// 交替使用：一个等待当前页的应答，另一个发送下一页的请求
+	shared_ptr<RedisConnect> redis;
+
+	bool isScan() const
+	{
+		return type == HSCAN || type == SSCAN || type == ZSCAN;
+	}
+	// 每个元素在应答中占用的项数
+	int getStep() const
+	{
+		return type == LRANGE || type == SSCAN ? 1 : 2;
+	}
+	int request(Command& cmd)
+	{
+		static const char* names[] = {"lrange", "zrange", "hscan", "sscan", "zscan"};
+
+		cmd = Command(names[type]);
+
+		if (isScan())
+		{
+			cmd.add(key, cursor);
+
+			if (pattern.size() > 0) cmd.add("match", pattern);
+
+			cmd.add("count", count);
+		}
+		else
+		{
+			int64 last = pos + count - 1;
+
+			if (end >= 0 && last >= end)
+			{
+				last = end;
+				done = true;
+			}
+
+			cmd.add(key, pos, last);
+
+			if (type == ZRANGE) cmd.add("withscores");
+
+			pos = last + 1;
+		}
+
+		if (redis->send(cmd, Socket::GetClock() + redis->getTimeout()) < 0) return redis->getErrorCode();
+
+		sent = true;
+
+		return RedisConnect::OK;
+	}
+	// 读取当前页的应答并预取下一页，成功返回当前页的命令(应答中的元素由element访问)
+	int fetch(Command*& page)
+	{
+		if (!redis && !(redis = RedisConnect::GetTemplate()->grasp())) return RedisConnect::NETERR;	// 不使用线程缓存的连接
+
+		if (sent == false)
+		{
+			if (done) return 0;
+
+			int res = request(cmds[cur]);
+
+			if (res < 0) return res;
+		}
+
+		Command& cmd = cmds[cur];
+		int res = redis->recv(cmd, Socket::GetClock() + redis->getTimeout());
+
+		sent = false;
+
+		if (res < 0)
+		{
+			if (res == RedisConnect::TIMEOUT) redis->skip++;	// 超时的应答由之后的命令丢弃
+
+			done = true;
+
+			return res;
+		}
+
+		const Reply& reply = cmd.getReply();
+		int len = 0;
+
+		if (isScan())
+		{
+			if (reply.isArray() == false || reply.size() != 2 || reply.at(1).isArray() == false)
+			{
+				done = true;
+
+				return RedisConnect::DATAERR;
+			}
+
+			cursor = reply.at(0).str();
+			len = reply.at(1).size() / getStep();
+
+			if (cursor == "0") done = true;
+		}
+		else
+		{
+			len = reply.size() / getStep();
+
+			if (len < count) done = true;
+		}
+
+		if (done == false)
+		{
+			cur = 1 - cur;
+
+			if ((res = request(cmds[cur])) < 0)
+			{
+				done = true;
+
+				return res;
+			}
+		}
+
+		page = &cmd;
+
+		return len;
+	}
+	// 当前页第idx项
+	Reply::Item element(const Command& page, int idx) const
+	{
+		return isScan() ? page.getReply().at(1)[idx] : page.getReply().at(idx);
+	}
+	// 读取下一个非空页(游标遍历的某一页可能没有元素)，func(page, idx)处理页中第idx个元素
+	template<class FUNC>
+	int visit(FUNC func)
+	{
+		while (true)
+		{
+			Command* page = NULL;
+			int len = fetch(page);
+
+			if (len < 0) return len;
+
+			for (int i = 0; i < len; i++) func(*page, i * getStep());
+
+			if (len > 0 || (sent == false && done)) return len;
+		}
+	}
+
+public:
+	// type为集合类型，count为每页的元素数量(游标遍历时作为COUNT参数，实际数量由服务端决定)，
+	// redis为迭代使用的连接，为空时从连接池获取(不使用线程缓存的连接)
+	RedisPager(int type, const string& key, int count = 100, shared_ptr<RedisConnect> redis = NULL) : type(type), count(max(count, 1)), key(key), redis(redis)
+	{
+	}
+	// 中途放弃时丢弃已预取的应答，连接可以继续使用
+	~RedisPager()
+	{
+		if (sent && redis) redis->skip++;
+	}
+	// 按下标读取时的范围(从start到end，end为-1表示到末尾)，需在读取第一页之前设置
+	void setRange(int64 start, int64 end = -1)
+	{
+		this->pos = max(start, (int64)(0));
+		this->end = end;
+	}
+	// 游标遍历时只返回匹配pattern的元素，需在读取第一页之前设置
+	void setMatch(const string& pattern)
+	{
+		this->pattern = pattern;
+	}
+	// 是否已经读取完所有页
+	bool isDone() const
+	{
+		return done && sent == false;
+	}
+	shared_ptr<RedisConnect> getConnect() const
+	{
+		return redis;
+	}
+	// 读取下一页(LRANGE、SSCAN)，返回元素数量，读取完毕返回0，失败返回错误码
+	int next(vector<string>& vec)
+	{
+		vec.clear();
+
+		if (type != LRANGE && type != SSCAN) return RedisConnect::PARAMERR;
+
+		return visit([&](const Command& page, int idx) {
+			vec.push_back(element(page, idx).str());
+		});
+	}
+	// 读取下一页(HSCAN)，值按连接的编码器解压
+	int next(vector<Field>& vec)
+	{
+		int err = 0;
+
+		vec.clear();
+
+		if (type != HSCAN) return RedisConnect::PARAMERR;
+
+		int res = visit([&](const Command& page, int idx) {
+			vec.push_back(Field(element(page, idx).str(), element(page, idx + 1).str()));
+
+			if (redis->unpack(vec.back().second) < 0) err = RedisConnect::DATAERR;
+		});
+
+		return res < 0 ? res : (err < 0 ? err : res);
+	}
+	// 读取下一页(ZRANGE、ZSCAN)，分数转换为double
+	int next(vector<Score>& vec)
+	{
+		vec.clear();
+
+		if (type != ZRANGE && type != ZSCAN) return RedisConnect::PARAMERR;
+
+		return visit([&](const Command& page, int idx) {
+			vec.push_back(Score(element(page, idx).str(), element(page, idx + 1).asDouble()));
+		});
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,429 @@
+#ifndef XG_REDISSHARD_H
+#define XG_REDISSHARD_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+// 客户端一致性哈希分片：多个独立的Redis实例组成哈希环(每个节点按权重放置若干虚拟节点)，
+// 每个节点有自己的连接池和熔断器。增删节点时只有落在该节点区间内的键需要迁移。
+// 键中包含{tag}时只对tag计算哈希(与Redis Cluster相同)，相关的键可以放在同一节点上
+class RedisShard
+{
+public:
+	static const int POINTS_PER_WEIGHT = 160;	// 每单位权重的虚拟节点数量
+	static const int MAX_WORKERS = 32;	// 批量命令并行访问各节点的常驻线程数量上限
+
+	struct Node
+	{
+		string name;	// 节点名称，决定其在哈希环上的位置(默认为host:port)
+		string host;
+		int port = 0;
+		int db = 0;
+		int weight = 1;
+		string passwd;
+	};
+
+protected:
+	struct Shard
+	{
+		Node node;
+		RedisConnect::Service service;
+
+		Shard(const RedisShard* owner, const Node& node) : node(node), service([owner, this]() { return owner->create(this->node); }, owner->maxlen)
+		{
+		}
+	};
+
+	struct Ring
+	{
+		vector<pair<u_int32, int>> points;	// 虚拟节点的哈希值和对应的分片下标，按哈希值排序
+		vector<shared_ptr<Shard>> shards;
+	};
+
+	mutex mtx;	// 串行化节点的增删，读取哈希环不加锁
+	int memsz;
+	int maxlen;
+	int timeout;
+	shared_ptr<RedisCodec> codec;
+	shared_ptr<Ring> ring;	// 最后声明、最先析构：析构时等待的探测线程仍会通过create读取以上配置
+
+	mutex taskMtx;
+	int idleCount = 0;
+	bool taskStop = false;
+	condition_variable taskCv;
+	vector<thread> workers;	// 常驻工作线程，按并发需要创建后一直保留到对象析构
+	deque<function<void()>> tasks;
+
+	void doTask()
+	{
+		unique_lock<mutex> lk(taskMtx);
+
+		while (true)
+		{
+			idleCount++;
+			taskCv.wait(lk, [&]() {
+				return taskStop || tasks.size() > 0;
+			});
+			idleCount--;
+
+			if (taskStop) break;
+
+			function<void()> task = std::move(tasks.front());
+
+			tasks.pop_front();
+			lk.unlock();
+			task();
+			lk.lock();
+		}
+	}
+	// 空闲线程不足且未达到上限时新建工作线程，否则排队等待已有线程处理
+	void submit(function<void()> task)
+	{
+		lock_guard<mutex> lk(taskMtx);
+
+		tasks.push_back(std::move(task));
+
+		if (idleCount < (int)(tasks.size()) && (int)(workers.size()) < MAX_WORKERS)
+		{
+			workers.push_back(thread(&RedisShard::doTask, this));
+		}
+		else
+		{
+			taskCv.notify_one();
+		}
+	}
+
+	shared_ptr<Ring> getRing() const
+	{
+		return atomic_load(&ring);
+	}
+	shared_ptr<Shard> locate(const shared_ptr<Ring>& ring, const string& key) const
+	{
+		if (ring->points.empty()) return NULL;
+
+		u_int32 hash = HashKey(key);
+		auto it = lower_bound(ring->points.begin(), ring->points.end(), pair<u_int32, int>(hash, -1));
+
+		if (it == ring->points.end()) it = ring->points.begin();	// 环形回绕
+
+		return ring->shards[it->second];
+	}
+	shared_ptr<RedisConnect> create(const Node& node) const
+	{
+		shared_ptr<RedisConnect> redis = make_shared<RedisConnect>();
+
+		if (redis->connect(node.host, node.port, timeout, memsz) == false) return NULL;
+
+		redis->setCodec(codec);
+
+		if (redis->auth(node.passwd) > 0 && redis->select(node.db) > 0) return redis;
+
+		return NULL;
+	}
+	shared_ptr<Shard> newShard(const Node& node)
+	{
+		return make_shared<Shard>(this, node);
+	}
+	void rebuild(vector<shared_ptr<Shard>>& shards)
+	{
+		shared_ptr<Ring> tmp = make_shared<Ring>();
+
+		for (size_t i = 0; i < shards.size(); i++)
+		{
+			const Node& node = shards[i]->node;
+			int cnt = POINTS_PER_WEIGHT * max(1, node.weight);
+
+			for (int j = 0; j < cnt; j++)
+			{
+				string str = node.name + "#" + to_string(j);
+
+				tmp->points.push_back(pair<u_int32, int>(Hash(str.c_str(), str.length()), (int)(i)));
+			}
+		}
+
+		sort(tmp->points.begin(), tmp->points.end());
+
+		tmp->shards.swap(shards);
+
+		atomic_store(&ring, tmp);
+	}
+public:
+	// FNV-1a哈希并混合高低位，分布均匀且与平台无关
+	static u_int32 Hash(const char* str, int len)
+	{
+		u_int64 val = 14695981039346656037ULL;
+
+		for (int i = 0; i < len; i++)
+		{
+			val ^= (u_char)(str[i]);
+			val *= 1099511628211ULL;
+		}
+
+		val ^= val >> 33;
+		val *= 0xFF51AFD7ED558CCDULL;
+		val ^= val >> 33;
+
+		return (u_int32)(val);
+	}
+	// 计算键的哈希值，键中包含非空的{tag}时只使用tag
+	static u_int32 HashKey(const string& key)
+	{
+		size_t start = key.find('{');
+
+		if (start != string::npos)
+		{
+			size_t end = key.find('}', start + 1);
+
+			if (end != string::npos && end > start + 1) return Hash(key.c_str() + start + 1, end - start - 1);
+		}
+
+		return Hash(key.c_str(), key.length());
+	}
+	// 每个节点的连接池上限为maxlen，连接的超时时间和缓冲区大小与RedisConnect::Setup的含义相同
+	RedisShard(int maxlen = 8, int timeout = 3000, int memsz = 2 * 1024 * 1024) : memsz(memsz), maxlen(maxlen), timeout(timeout)
+	{
+		ring = make_shared<Ring>();
+	}
+	~RedisShard()
+	{
+		{
+			lock_guard<mutex> lk(taskMtx);
+
+			taskStop = true;
+			taskCv.notify_all();
+		}
+
+		for (thread& worker : workers) worker.join();
+	}
+	// 设置所有节点连接使用的值压缩编码器，需在添加节点之前设置
+	void setCodec(shared_ptr<RedisCodec> codec)
+	{
+		this->codec = codec;
+	}
+	// 添加节点，name为空时使用host:port，名称已存在时替换该节点的配置
+	bool add(const string& host, int port, const string& passwd = "", int db = 0, int weight = 1, const string& name = "")
+	{
+		Node node;
+
+		node.db = db;
+		node.host = host;
+		node.port = port;
+		node.weight = weight;
+		node.passwd = passwd;
+		node.name = name.empty() ? host + ":" + to_string(port) : name;
+
+		lock_guard<mutex> lk(mtx);
+		vector<shared_ptr<Shard>> shards = getRing()->shards;
+
+		for (shared_ptr<Shard>& item : shards)
+		{
+			if (item->node.name == node.name)
+			{
+				item = newShard(node);
+				rebuild(shards);
+
+				return true;
+			}
+		}
+
+		shards.push_back(newShard(node));
+		rebuild(shards);
+
+		return true;
+	}
+	// 移除节点，原来属于该节点的键由环上的下一个节点接管，其它键的位置不变
+	bool remove(const string& name)
+	{
+		lock_guard<mutex> lk(mtx);
+		vector<shared_ptr<Shard>> shards = getRing()->shards;
+
+		for (size_t i = 0; i < shards.size(); i++)
+		{
+			if (shards[i]->node.name == name)
+			{
+				shards.erase(shards.begin() + i);
+				rebuild(shards);
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+	int size() const
+	{
+		return getRing()->shards.size();
+	}
+	// 键所在节点的名称，没有节点时返回空字符串
+	string locate(const string& key) const
+	{
+		shared_ptr<Shard> shard = locate(getRing(), key);
+
+		return shard ? shard->node.name : string();
+	}
+	// 从键所在节点的连接池获取连接，节点熔断或无法连接时返回NULL
+	shared_ptr<RedisConnect> get(const string& key)
+	{
+		shared_ptr<Shard> shard = locate(getRing(), key);
+
+		return shard ? shard->service.grasp() : NULL;
+	}
+	// 将keys按所在节点分组后由常驻工作线程并行执行func(redis, 该节点的键, 这些键在keys中的下标)，
+	// 各节点的返回值累加后返回，任一节点失败时返回其错误码
+	template<class FUNC>
+	int fanout(const vector<string>& keys, FUNC func)
+	{
+		shared_ptr<Ring> ring = getRing();
+		int len = ring->shards.size();
+
+		if (len == 0) return RedisConnect::NETERR;
+
+		vector<vector<int>> idxs(len);
+		vector<vector<string>> groups(len);
+
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			u_int32 hash = HashKey(keys[i]);
+			auto it = lower_bound(ring->points.begin(), ring->points.end(), pair<u_int32, int>(hash, -1));
+
+			if (it == ring->points.end()) it = ring->points.begin();
+
+			idxs[it->second].push_back((int)(i));
+			groups[it->second].push_back(keys[i]);
+		}
+
+		mutex waitMtx;
+		int pending = 0;
+		vector<int> res(len, 0);
+		condition_variable waitCv;
+
+		auto doWork = [&](int idx) {
+			shared_ptr<RedisConnect> redis = ring->shards[idx]->service.grasp();
+
+			res[idx] = redis ? func(*redis, groups[idx], idxs[idx]) : RedisConnect::NETERR;
+		};
+
+		int last = -1;
+
+		for (int i = 0; i < len; i++)
+		{
+			if (groups[i].empty()) continue;
+
+			if (last >= 0)	// 最后一组在当前线程中执行，其它组交给常驻工作线程
+			{
+				{
+					lock_guard<mutex> lk(waitMtx);
+
+					pending++;
+				}
+
+				submit([&, last]() {
+					doWork(last);
+
+					lock_guard<mutex> lk(waitMtx);
+
+					if (--pending == 0) waitCv.notify_all();
+				});
+			}
+
+			last = i;
+		}
+
+		if (last >= 0) doWork(last);
+
+		unique_lock<mutex> lk(waitMtx);
+
+		waitCv.wait(lk, [&]() {
+			return pending == 0;
+		});
+
+		lk.unlock();
+
+		int num = 0;
+
+		for (int i = 0; i < len; i++)
+		{
+			if (res[i] < 0) return res[i];
+
+			num += res[i];
+		}
+
+		return num;
+	}
+	// 批量获取键值，结果与keys一一对应(不存在的键为空字符串)，返回存在的键数量
+	int mget(const vector<string>& keys, vector<string>& vals)
+	{
+		vals.assign(keys.size(), string());
+
+		return fanout(keys, [&](RedisConnect& redis, const vector<string>& list, const vector<int>& idxs) {
+			vector<string> tmp;
+			int res = redis.mget(list, tmp);
+
+			if (res < 0) return res;
+
+			for (size_t i = 0; i < idxs.size(); i++) vals[idxs[i]].swap(tmp[i]);
+
+			return res;
+		});
+	}
+	// 批量设置键值，成功返回设置的键数量
+	template<class DATA_MAP>
+	int mset(const DATA_MAP& data)
+	{
+		vector<string> keys;
+		vector<const string*> vals;
+
+		keys.reserve(data.size());
+		vals.reserve(data.size());
+
+		for (const auto& item : data)
+		{
+			keys.push_back(item.first);
+			vals.push_back(&item.second);
+		}
+
+		return fanout(keys, [&](RedisConnect& redis, const vector<string>& list, const vector<int>& idxs) {
+			vector<pair<string, string>> tmp;
+
+			tmp.reserve(idxs.size());
+
+			for (size_t i = 0; i < idxs.size(); i++) tmp.push_back(pair<string, string>(list[i], *vals[idxs[i]]));
+
+			int res = redis.mset(tmp);
+
+			return res < 0 ? res : (int)(tmp.size());
+		});
+	}
+	// 批量删除键值，返回删除的键数量
+	int del(const vector<string>& keys)
+	{
+		return fanout(keys, [](RedisConnect& redis, const vector<string>& list, const vector<int>&) {
+			return redis.del(list);
+		});
+	}
+	int get(const string& key, string& val)
+	{
+		shared_ptr<RedisConnect> redis = get(key);
+
+		return redis ? redis->get(key, val) : RedisConnect::NETERR;
+	}
+	int set(const string& key, const string& val, int timeout = 0)
+	{
+		shared_ptr<RedisConnect> redis = get(key);
+
+		return redis ? redis->set(key, val, timeout) : RedisConnect::NETERR;
+	}
+	int del(const string& key)
+	{
+		shared_ptr<RedisConnect> redis = get(key);
+
+		return redis ? redis->del(key) : RedisConnect::NETERR;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
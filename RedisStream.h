@@ -0,0 +1,324 @@
+#ifndef XG_REDISSTREAM_H
+#define XG_REDISSTREAM_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+// Stream队列：生产者以流水线批量XADD写入；消费者组读取使用独立连接，BLOCK等待不受普通命令超时的限制，
+// 每次读取COUNT条消息，确认(XACK)先在本地积累，随下一次读取以同一次写入发送
+class RedisStream
+{
+	typedef RedisConnect::Reply Reply;
+	typedef RedisConnect::Command Command;
+
+public:
+	typedef vector<pair<string, string>> FieldList;
+
+	struct Entry
+	{
+		string id;	// 消息编号
+		FieldList fields;	// 消息内容(已被删除的待确认消息为空)
+
+		// 获取字段值，字段不存在时返回NULL
+		const string* get(const string& name) const
+		{
+			for (const pair<string, string>& item : fields)
+			{
+				if (item.first == name) return &item.second;
+			}
+
+			return NULL;
+		}
+	};
+
+protected:
+	int count = 100;
+	int block = 1000;
+	int maxlen = 0;
+	string key;
+	string group;
+	string consumer;
+	vector<string> acks;	// 等待发送的确认
+	shared_ptr<RedisConnect> reader;	// 消费者组读取专用的连接
+
+	// 解析消息数组[[id, [field, value, ...]], ...]并追加到vec，返回解析的消息数量
+	static int Parse(const Reply::Item& item, vector<Entry>& vec)
+	{
+		int num = 0;
+
+		if (item.isArray() == false) return 0;
+
+		for (int i = 0; i < item.size(); i++)
+		{
+			Reply::Item msg = item[i];
+
+			if (msg.isArray() == false || msg.size() < 2) continue;
+
+			Entry entry;
+			Reply::Item data = msg[1];
+
+			entry.id = msg[0].str();
+
+			for (int j = 0; j + 1 < data.size(); j += 2)
+			{
+				entry.fields.push_back(pair<string, string>(data[j].str(), data[j + 1].str()));
+			}
+
+			vec.push_back(std::move(entry));
+			num++;
+		}
+
+		return num;
+	}
+	static void AddFields(Command& cmd, const FieldList& fields)
+	{
+		for (const pair<string, string>& item : fields)
+		{
+			cmd.add(item.first);
+			cmd.add(item.second);
+		}
+	}
+	Command* addCommand(vector<Command>& cmds, const Entry& entry) const
+	{
+		cmds.push_back(Command("xadd"));
+
+		Command& cmd = cmds.back();
+
+		cmd.add(key);
+
+		if (maxlen > 0) cmd.add("maxlen", "~", maxlen);	// 近似裁剪，代价远小于精确裁剪
+
+		cmd.add(entry.id.empty() ? string("*") : entry.id);
+
+		AddFields(cmd, entry.fields);
+
+		return &cmd;
+	}
+	// 将等待中的确认按每批BATCH_MAXLEN个编号生成XACK命令
+	void addAcks(vector<Command>& cmds) const
+	{
+		size_t idx = 0;
+
+		while (idx < acks.size())
+		{
+			cmds.push_back(Command("xack"));
+
+			Command& cmd = cmds.back();
+
+			cmd.add(key, group);
+
+			for (size_t end = min(acks.size(), idx + RedisConnect::BATCH_MAXLEN); idx < end; idx++) cmd.add(acks[idx]);
+		}
+	}
+	// 读取专用连接，已损坏时重连
+	RedisConnect* getReader()
+	{
+		if (reader && reader->isBroken() == false) return reader.get();
+
+		if (reader)
+		{
+			if (reader->reconnect()) return reader.get();
+		}
+		else
+		{
+			if (reader = RedisConnect::Create()) return reader.get();
+		}
+
+		return NULL;
+	}
+
+public:
+	// maxlen大于0时写入的同时将Stream近似裁剪到该长度
+	RedisStream(const string& key, int maxlen = 0) : maxlen(maxlen), key(key)
+	{
+	}
+	const string& getKey() const
+	{
+		return key;
+	}
+	// 写入一条消息，id返回服务端生成的消息编号
+	int add(RedisConnect& redis, const FieldList& fields, string& id)
+	{
+		Entry entry;
+		vector<Command> cmds;
+
+		entry.fields = fields;
+		addCommand(cmds, entry);
+
+		if (redis.execute(cmds[0]) < 0) return redis.getErrorCode();
+
+		id = cmds[0].getReply().str();
+
+		return RedisConnect::OK;
+	}
+	// 流水线批量写入，每批不超过BATCH_MAXLEN条，ids返回与list一一对应的消息编号，返回写入的数量
+	int add(RedisConnect& redis, const vector<Entry>& list, vector<string>& ids)
+	{
+		int num = 0;
+		size_t idx = 0;
+
+		ids.assign(list.size(), string());
+
+		while (idx < list.size())
+		{
+			size_t start = idx;
+			vector<Command> cmds;
+			vector<Command*> ptrs;
+
+			cmds.reserve(RedisConnect::BATCH_MAXLEN);
+
+			while (idx < list.size() && idx - start < (size_t)(RedisConnect::BATCH_MAXLEN)) ptrs.push_back(addCommand(cmds, list[idx++]));
+
+			int res = redis.pipeline(ptrs, redis.getTimeout());
+
+			if (res < 0) return res;
+
+			for (size_t i = 0; i < cmds.size(); i++)
+			{
+				if (cmds[i].getCode() < 0) continue;
+
+				ids[start + i] = cmds[i].getReply().str();
+				num++;
+			}
+		}
+
+		return num;
+	}
+	// 以consumer的身份加入消费者组(不存在时创建组和Stream)，start为新建组的起始位置("$"只消费之后的消息，"0"从头开始)，
+	// 之后每次read最多读取count条消息，没有消息时最多等待block毫秒(小于等于0时不等待)
+	int join(const string& group, const string& consumer, const string& start = "$", int count = 100, int block = 1000)
+	{
+		RedisConnect* redis = NULL;
+
+		this->group = group;
+		this->consumer = consumer;
+		this->count = count;
+		this->block = block;
+
+		acks.clear();
+
+		if ((redis = getReader()) == NULL) return RedisConnect::NETERR;
+
+		Command cmd("xgroup");
+
+		cmd.add("create", key, group, start, "mkstream");
+
+		if (redis->execute(cmd) > 0) return RedisConnect::OK;
+
+		// 组已经存在
+		if (cmd.getCode() == RedisConnect::FAIL && cmd.getMessage().find("BUSYGROUP") != string::npos) return RedisConnect::OK;
+
+		return cmd.getCode();
+	}
+	// 读取分配给本消费者的新消息，等待确认的消息随本次读取一起发送，返回读取的消息数量(等待超时为0)
+	int read(vector<Entry>& vec)
+	{
+		RedisConnect* redis = NULL;
+		vector<Command> cmds;
+		vector<Command*> ptrs;
+
+		vec.clear();
+
+		if ((redis = getReader()) == NULL) return RedisConnect::NETERR;
+
+		addAcks(cmds);
+
+		cmds.push_back(Command("xreadgroup"));
+		cmds.back().add("group", group, consumer, "count", count);
+
+		if (block > 0) cmds.back().add("block", block);	// BLOCK 0表示一直等待，不使用
+
+		cmds.back().add("streams", key, ">");
+
+		for (Command& cmd : cmds) ptrs.push_back(&cmd);
+
+		// BLOCK期间服务端不会应答，命令超时需要加上等待时间
+		int res = redis->pipeline(ptrs, redis->getTimeout() + block);
+
+		if (res < 0) return res;	// 确认保留在本地，下次重新发送(XACK是幂等的)
+
+		acks.clear();
+
+		Command& cmd = cmds.back();
+
+		if (cmd.getCode() == RedisConnect::NOTFOUND) return 0;	// 等待超时没有新消息
+
+		if (cmd.getCode() < 0) return cmd.getCode();
+
+		Reply::Item reply = cmd.getReply().root();
+
+		for (int i = 0; i < reply.size(); i++)
+		{
+			Reply::Item item = reply[i];
+
+			if (item.isArray() && item.size() >= 2) Parse(item[1], vec);
+		}
+
+		return vec.size();
+	}
+	// 确认消息已处理完成，确认在下一次read或flush时批量发送
+	void ack(const string& id)
+	{
+		acks.push_back(id);
+	}
+	void ack(const vector<Entry>& vec)
+	{
+		for (const Entry& entry : vec) acks.push_back(entry.id);
+	}
+	// 立即发送等待中的确认，返回服务端确认的消息数量
+	int flush()
+	{
+		int num = 0;
+		RedisConnect* redis = NULL;
+		vector<Command> cmds;
+		vector<Command*> ptrs;
+
+		if (acks.empty()) return 0;
+
+		if ((redis = getReader()) == NULL) return RedisConnect::NETERR;
+
+		addAcks(cmds);
+
+		for (Command& cmd : cmds) ptrs.push_back(&cmd);
+
+		int res = redis->pipeline(ptrs, redis->getTimeout());
+
+		if (res < 0) return res;
+
+		for (Command& cmd : cmds) num += cmd.getStatus();
+
+		acks.clear();
+
+		return num;
+	}
+	// 将空闲超过minidle毫秒的待确认消息(如崩溃的消费者未确认的消息)转移给本消费者，
+	// cursor为扫描位置，首次传入"0-0"，返回"0-0"时表示已扫描完全部待确认消息，返回转移的消息数量
+	int claim(vector<Entry>& vec, int minidle, string& cursor)
+	{
+		RedisConnect* redis = getReader();
+
+		vec.clear();
+
+		if (redis == NULL) return RedisConnect::NETERR;
+
+		Command cmd("xautoclaim");
+
+		cmd.add(key, group, consumer, minidle, cursor.empty() ? string("0-0") : cursor, "count", count);
+
+		if (redis->execute(cmd) < 0) return cmd.getCode();
+
+		Reply::Item reply = cmd.getReply().root();
+
+		if (reply.size() < 2) return RedisConnect::DATAERR;
+
+		cursor = reply[0].str();
+
+		return Parse(reply[1], vec);
+	}
+	// 尚未发送的确认数量
+	int pending() const
+	{
+		return acks.size();
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,218 @@
+#ifndef XG_REDISURING_H
+#define XG_REDISURING_H
+//////////////////////////////////////////////////////////////////////////////
+#include "typedef.h"
+
+#if defined(XG_LINUX) && defined(XG_URING)
+
+#include <memory>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+using namespace std;
+
+// io_uring收发：每个线程一个小的提交队列，一次io_uring_enter同时提交收发操作并按截止时间等待完成，
+// 替代原来“recv返回EAGAIN、poll等待、再次recv”的多次系统调用。直接使用系统调用，不依赖liburing
+class RedisUring
+{
+	int fd = -1;
+	unsigned* sqTail = NULL;
+	unsigned* sqMask = NULL;
+	unsigned* sqArray = NULL;
+	unsigned* cqHead = NULL;
+	unsigned* cqTail = NULL;
+	unsigned* cqMask = NULL;
+	struct io_uring_sqe* sqes = NULL;
+	struct io_uring_cqe* cqes = NULL;
+	void* sqPtr = MAP_FAILED;
+	void* cqPtr = MAP_FAILED;
+	size_t sqLen = 0;
+	size_t cqLen = 0;
+	size_t sqeLen = 0;
+
+	static int Setup(unsigned entries, struct io_uring_params* params)
+	{
+		return (int)(syscall(__NR_io_uring_setup, entries, params));
+	}
+	static int Enter(int fd, unsigned submit, unsigned wait, struct __kernel_timespec* ts)
+	{
+		if (ts == NULL) return (int)(syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0));
+
+		struct io_uring_getevents_arg arg;
+
+		memset(&arg, 0, sizeof(arg));
+
+		arg.ts = (u_int64)(ts);
+
+		return (int)(syscall(__NR_io_uring_enter, fd, submit, wait, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)));
+	}
+	bool init(unsigned entries)
+	{
+		struct io_uring_params params;
+
+		memset(&params, 0, sizeof(params));
+
+		if ((fd = Setup(entries, &params)) < 0) return false;
+
+		if ((params.features & IORING_FEAT_EXT_ARG) == 0) return false;	// 需要5.11以上的内核
+
+		sqLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cqLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+		sqeLen = params.sq_entries * sizeof(struct io_uring_sqe);
+
+		// 新内核的提交队列和完成队列共用一次映射
+		if (params.features & IORING_FEAT_SINGLE_MMAP) sqLen = cqLen = max(sqLen, cqLen);
+
+		if ((sqPtr = mmap(NULL, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING)) == MAP_FAILED) return false;
+
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			cqPtr = sqPtr;
+		}
+		else if ((cqPtr = mmap(NULL, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+		{
+			return false;
+		}
+
+		void* ptr = mmap(NULL, sqeLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+		if (ptr == MAP_FAILED) return false;
+
+		char* sq = (char*)(sqPtr);
+		char* cq = (char*)(cqPtr);
+
+		sqes = (struct io_uring_sqe*)(ptr);
+		sqTail = (unsigned*)(sq + params.sq_off.tail);
+		sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+		sqArray = (unsigned*)(sq + params.sq_off.array);
+		cqHead = (unsigned*)(cq + params.cq_off.head);
+		cqTail = (unsigned*)(cq + params.cq_off.tail);
+		cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+		cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+		return true;
+	}
+	struct io_uring_sqe* prepare(unsigned& tail, u_char opcode, int sock, const void* data, unsigned len, u_int64 tag)
+	{
+		unsigned idx = tail++ & *sqMask;
+		struct io_uring_sqe* sqe = &sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+
+		sqe->fd = sock;
+		sqe->opcode = opcode;
+		sqe->addr = (u_int64)(data);
+		sqe->len = len;
+		sqe->user_data = tag;
+		sqArray[idx] = idx;
+
+		return sqe;
+	}
+	// 提交收发操作并等待完成，最多等待timeout毫秒(等待时间由io_uring_enter的参数指定，不需要为每次操作创建定时器)，
+	// 超时后取消操作并等待其结束，返回收发的结果(超时返回-ETIME)
+	int execute(u_char opcode, int sock, const void* data, int len, int64 timeout)
+	{
+		unsigned tail = *sqTail;
+		struct __kernel_timespec ts;
+		struct io_uring_sqe* sqe = prepare(tail, opcode, sock, data, len, 1);
+
+		if (opcode == IORING_OP_SEND) sqe->msg_flags = MSG_NOSIGNAL;
+
+		__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = timeout % 1000 * 1000000;
+
+		int res = 0;
+		int num = Enter(fd, 1, 1, &ts);
+
+		while (num < 0 && errno == EINTR) num = Enter(fd, 0, 1, &ts);
+
+		if (num < 0 && errno != ETIME) return -errno;
+
+		if (reap(res) & 1) return res;
+
+		// 等待超时：取消操作，操作和取消请求的完成事件都收取后才能返回，避免影响之后的等待
+		int done = 0;
+
+		tail = *sqTail;
+		prepare(tail, IORING_OP_ASYNC_CANCEL, -1, (void*)(1), 0, 2);
+
+		__atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+		Enter(fd, 1, 0, NULL);
+
+		while ((done |= reap(res)) != 3) Enter(fd, 0, 1, NULL);
+
+		return res == -ECANCELED ? -ETIME : res;
+	}
+	// 收取完成事件，返回收到的事件标记(1为收发操作，2为取消请求)，收到收发操作的结果时设置res
+	int reap(int& res)
+	{
+		int flag = 0;
+		unsigned head = *cqHead;
+
+		while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe* cqe = &cqes[head++ & *cqMask];
+
+			if (cqe->user_data == 1) res = cqe->res;
+
+			flag |= (int)(cqe->user_data);
+		}
+
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+		return flag;
+	}
+
+public:
+	RedisUring()
+	{
+		if (init(4) == false) close();
+	}
+	~RedisUring()
+	{
+		close();
+	}
+	void close()
+	{
+		if (sqes) munmap(sqes, sqeLen);
+		if (cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqLen);
+		if (sqPtr != MAP_FAILED) munmap(sqPtr, sqLen);
+		if (fd >= 0) ::close(fd);
+
+		fd = -1;
+		sqes = NULL;
+		sqPtr = cqPtr = MAP_FAILED;
+	}
+	bool isValid() const
+	{
+		return fd >= 0;
+	}
+	// 接收数据，最多等待timeout毫秒，返回接收的字节数、0(连接关闭)或负的错误码(超时为-ETIME)
+	int recv(int sock, void* data, int len, int64 timeout)
+	{
+		return execute(IORING_OP_RECV, sock, data, len, timeout);
+	}
+	int send(int sock, const void* data, int len, int64 timeout)
+	{
+		return execute(IORING_OP_SEND, sock, data, len, timeout);
+	}
+	// 当前线程的实例，内核不支持(或被禁用)时返回NULL
+	static RedisUring* Local()
+	{
+		thread_local unique_ptr<RedisUring> ring(new RedisUring());
+
+		return ring->isValid() ? ring.get() : NULL;
+	}
+};
+
+#endif
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,360 @@
+#ifndef XG_REDISWRITER_H
+#define XG_REDISWRITER_H
+//////////////////////////////////////////////////////////////////////////////
+#include "RedisConnect.h"
+
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+// 异步写队列：调用线程只把命令放入有界无锁环形队列后立即返回，由后台线程使用独立连接批量流水线发送，
+// 适合不关心结果的写入(如带过期时间的SET、日志列表RPUSH、EXPIRE)。开启noreply时每批命令以
+// CLIENT REPLY OFF/ON包围，服务端只对整批返回一个应答。队列满时按策略阻塞等待或丢弃新命令
+class RedisWriter
+{
+	typedef RedisConnect::Socket Socket;
+	typedef RedisConnect::Command Command;
+	typedef function<shared_ptr<RedisConnect>()> Creator;
+
+public:
+	static const int DROP = 0;	// 队列满时丢弃新命令
+	static const int BLOCK = 1;	// 队列满时等待空位(最多等待blocktime毫秒，小于0时一直等待)
+
+	struct Stat
+	{
+		int size;	// 队列中等待发送的命令数
+		int64 pushCount;	// 进入队列的命令数
+		int64 dropCount;	// 队列满被丢弃以及析构时连接失败未发送的命令数
+		int64 writeCount;	// 发送成功的命令数
+		int64 failCount;	// 发送失败或服务端返回错误的命令数
+		int64 batchCount;	// 发送的批次数
+	};
+
+protected:
+	// 多生产者环形队列(Dmitry Vyukov的有界队列)，seq标记槽位所处的轮次
+	struct Slot
+	{
+		atomic<size_t> seq;
+		Command cmd;
+	};
+
+	mutex mtx;
+	bool stop = false;
+	int policy;
+	int blocktime;
+	bool noreply;
+	size_t mask;
+	thread worker;
+	Creator creator;
+	vector<Slot> slots;
+	atomic<bool> idle;	// 后台线程是否正在等待新命令
+	atomic<size_t> head;	// 下一个出队位置(只有后台线程修改)
+	atomic<size_t> tail;	// 下一个入队位置
+	atomic<int64> pushCount;
+	atomic<int64> dropCount;
+	atomic<int64> writeCount;
+	atomic<int64> failCount;
+	atomic<int64> batchCount;
+	condition_variable cv;
+	shared_ptr<RedisConnect> redis;
+
+	bool tryPush(Command& cmd)
+	{
+		size_t pos = tail.load(memory_order_relaxed);
+
+		while (true)
+		{
+			Slot& slot = slots[pos & mask];
+			size_t seq = slot.seq.load(memory_order_acquire);
+
+			if (seq == pos)
+			{
+				if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed))
+				{
+					std::swap(slot.cmd, cmd);
+					slot.seq.store(pos + 1, memory_order_release);
+
+					return true;
+				}
+			}
+			else if (seq < pos)
+			{
+				return false;	// 队列已满
+			}
+			else
+			{
+				pos = tail.load(memory_order_relaxed);
+			}
+		}
+	}
+	// 取出最多maxlen条命令(只在后台线程中调用)
+	void pop(vector<Command>& vec, size_t maxlen)
+	{
+		size_t pos = head.load(memory_order_relaxed);
+
+		while (vec.size() < maxlen)
+		{
+			Slot& slot = slots[pos & mask];
+
+			if (slot.seq.load(memory_order_acquire) != pos + 1) break;
+
+			vec.push_back(Command());
+			std::swap(vec.back(), slot.cmd);
+			slot.seq.store(pos + slots.size(), memory_order_release);
+
+			head.store(++pos, memory_order_relaxed);
+		}
+	}
+	void notify()
+	{
+		if (idle)
+		{
+			lock_guard<mutex> lk(mtx);
+
+			cv.notify_one();
+		}
+	}
+	RedisConnect* getConnect()
+	{
+		if (redis && redis->isBroken() == false) return redis.get();
+
+		if (redis)
+		{
+			if (redis->reconnect()) return redis.get();
+		}
+		else
+		{
+			if (redis = creator()) return redis.get();
+		}
+
+		return NULL;
+	}
+	// 发送一批命令，返回成功的命令数量
+	int write(vector<Command>& cmds)
+	{
+		RedisConnect* redis = getConnect();
+
+		if (redis == NULL) return RedisConnect::NETERR;
+
+		batchCount++;
+
+		if (noreply)
+		{
+			Command head("client");
+			Command last("client");
+			const int64 deadline = Socket::GetClock() + redis->getTimeout();
+
+			head.add("reply", "off");
+			last.add("reply", "on");
+
+			string data = head.toString();
+
+			for (Command& cmd : cmds) data += cmd.toString();
+
+			data += last.toString();
+
+			int res = redis->sock.write(data.c_str(), data.length(), deadline);
+
+			if (res >= 0) res = redis->recv(last, deadline);	// 整批只有CLIENT REPLY ON的应答
+
+			if (res < 0)
+			{
+				redis->close();
+
+				return res;
+			}
+
+			return cmds.size();
+		}
+
+		int num = 0;
+		vector<Command*> ptrs;
+
+		for (Command& cmd : cmds) ptrs.push_back(&cmd);
+
+		int res = redis->pipeline(ptrs, redis->getTimeout());
+
+		if (res < 0) return res;
+
+		for (Command& cmd : cmds)
+		{
+			if (cmd.getCode() > 0) num++;
+		}
+
+		return num;
+	}
+	void run()
+	{
+		bool discard = false;	// 析构时连接失败，剩余命令不再发送
+		vector<Command> cmds;
+
+		while (true)
+		{
+			cmds.clear();
+
+			pop(cmds, RedisConnect::BATCH_MAXLEN);
+
+			if (cmds.empty())
+			{
+				unique_lock<mutex> lk(mtx);
+
+				if (stop) break;
+
+				idle = true;
+
+				// 设置idle后再检查一次，避免错过刚入队的命令
+				if (slots[head & mask].seq.load(memory_order_acquire) != head + 1) cv.wait_for(lk, chrono::milliseconds(100));
+
+				idle = false;
+
+				continue;
+			}
+
+			if (discard)
+			{
+				dropCount += cmds.size();
+
+				continue;
+			}
+
+			int num = write(cmds);
+
+			// 连接失败时整批丢弃(无法确定服务端是否已经执行)，稍后重连。
+			// 析构时不再逐批重连(每批都可能等待连接超时)，剩余命令直接丢弃
+			if (num < 0)
+			{
+				failCount += cmds.size();
+
+				unique_lock<mutex> lk(mtx);
+
+				if (stop)
+				{
+					discard = true;
+				}
+				else
+				{
+					cv.wait_for(lk, chrono::milliseconds(100));
+				}
+
+				continue;
+			}
+
+			writeCount += num;
+			failCount += cmds.size() - num;
+		}
+	}
+
+public:
+	// capacity为队列容量(向上取整为2的幂)，policy为队列满时的策略，noreply为true时使用CLIENT REPLY OFF发送，
+	// creator提供后台线程独占使用的连接(连接的应答模式会被修改，不能放回连接池)
+	RedisWriter(int capacity = 65536, int policy = DROP, int blocktime = -1, bool noreply = false, Creator creator = RedisConnect::Create) : policy(policy), blocktime(blocktime), noreply(noreply), creator(creator)
+	{
+		size_t len = 2;
+
+		while (len < (size_t)(capacity)) len <<= 1;
+
+		slots = vector<Slot>(len);
+
+		for (size_t i = 0; i < len; i++) slots[i].seq = i;
+
+		mask = len - 1;
+		head = tail = 0;
+		idle = false;
+		pushCount = dropCount = writeCount = failCount = batchCount = 0;
+
+		worker = thread(&RedisWriter::run, this);
+	}
+	// 析构时发送完队列中剩余的命令，连接失败时剩余命令计入dropCount后直接丢弃
+	~RedisWriter()
+	{
+		{
+			lock_guard<mutex> lk(mtx);
+
+			stop = true;
+			cv.notify_all();
+		}
+
+		if (worker.joinable()) worker.join();
+	}
+	// 命令放入队列，队列满且按策略放弃时返回false
+	bool push(Command& cmd)
+	{
+		if (tryPush(cmd) == false)
+		{
+			if (policy == DROP)
+			{
+				dropCount++;
+
+				return false;
+			}
+
+			int times = 0;
+			int64 deadline = blocktime < 0 ? 0 : Socket::GetClock() + blocktime;
+
+			while (true)
+			{
+				notify();
+
+				if (deadline > 0 && Socket::GetClock() > deadline)
+				{
+					dropCount++;
+
+					return false;
+				}
+
+				// 先让出时间片，等待较久时再休眠
+				if (++times < 64)
+				{
+					std::this_thread::yield();
+				}
+				else
+				{
+					Sleep(1);
+				}
+
+				if (tryPush(cmd)) break;
+			}
+		}
+
+		pushCount++;
+		notify();
+
+		return true;
+	}
+	template<class ...ARGS>
+	bool execute(const string& name, ARGS ...args)
+	{
+		Command cmd(name);
+
+		cmd.add(args...);
+
+		return push(cmd);
+	}
+	bool set(const string& key, const string& val, int timeout = 0)
+	{
+		return timeout > 0 ? execute("set", key, val, "ex", timeout) : execute("set", key, val);
+	}
+	bool rpush(const string& key, const string& val)
+	{
+		return execute("rpush", key, val);
+	}
+	bool expire(const string& key, int timeout)
+	{
+		return execute("expire", key, timeout);
+	}
+	Stat getStat() const
+	{
+		Stat stat;
+
+		stat.size = tail - head;
+		stat.pushCount = pushCount;
+		stat.dropCount = dropCount;
+		stat.writeCount = writeCount;
+		stat.failCount = failCount;
+		stat.batchCount = batchCount;
+
+		return stat;
+	}
+};
+//////////////////////////////////////////////////////////////////////////////
+#endif
@@ -4,7 +4,9 @@
 #include "typedef.h"
 
 #include <ctime>
+#include <chrono>
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <memory>
@@ -46,29 +48,237 @@ template<typename T> class ResPool
 		}
 	};
 
+public:
+	static const int HIGH = 0;	// 获取资源的优先级
+	static const int NORMAL = 1;
+	static const int LOW = 2;
+	static const int PRIORITY_COUNT = 3;
+
+	struct Stat
+	{
+		int minlen;	// 自适应的下限(未开启自适应时等于上限)
+		int maxlen;	// 上限
+		int limit;	// 当前的容量
+		int size;	// 持有的资源数量
+		int inuse;	// 正在使用的资源数量
+		int peak;	// 本统计周期内同时使用的最大数量
+		int64 getCount;	// 获取资源的次数
+		int64 waitCount;	// 容量已满需要等待的次数
+		int64 waitTime;	// 累计等待时间(毫秒)
+		int64 growCount;	// 扩容次数
+		int64 shrinkCount;	// 缩容次数
+		int reserve;	// 只有高优先级可以使用的容量
+		int weights[PRIORITY_COUNT];	// 各优先级的调度权重
+		int64 prioGetCount[PRIORITY_COUNT];	// 各优先级获取资源的次数
+		int64 prioWaitCount[PRIORITY_COUNT];	// 各优先级需要等待的次数
+		int64 prioWaitTime[PRIORITY_COUNT];	// 各优先级累计等待时间(毫秒)
+	};
+
 protected:
 	mutex mtx;
 	int maxlen;
+	int minlen = 0;	// 大于0时开启自适应
+	int limit;
 	int timeout;
+	int interval = 1000;	// 自适应调整的周期(毫秒)
+	int peak = 0;
+	int64 lastAdjust = 0;
+	int64 lastGrow = 0;
+	int64 getCount = 0;
+	int64 waitCount = 0;
+	int64 waitTime = 0;
+	int64 growCount = 0;
+	int64 shrinkCount = 0;
+	int reserve = 0;
+	int pending = 0;	// 正在创建的资源数量(创建期间已占用容量)
+	atomic<int64> epoch{0};	// 每次clear加一，清空之前开始创建的资源不再放入
+	int weights[PRIORITY_COUNT] = {8, 4, 1};
+	int waiters[PRIORITY_COUNT] = {0, 0, 0};	// 各优先级正在等待的调用方数量
+	int64 vtimes[PRIORITY_COUNT] = {0, 0, 0};	// 各优先级的虚拟时间(每次获取增加权重的倒数)
+	int64 prioGetCount[PRIORITY_COUNT] = {0, 0, 0};
+	int64 prioWaitCount[PRIORITY_COUNT] = {0, 0, 0};
+	int64 prioWaitTime[PRIORITY_COUNT] = {0, 0, 0};
 	vector<Data> vec;
 	function<shared_ptr<T>()> func;
 
+	static int64 GetClock()
+	{
+		return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	// 释放超出容量的空闲资源，正在使用的资源不受影响(调用时已持有锁)
+	void trim()
+	{
+		int held = 0;
+
+		for (Data& item : vec)
+		{
+			if (item.data) held++;
+		}
+
+		for (size_t i = vec.size(); i > 0 && held > limit; i--)
+		{
+			Data& item = vec[i - 1];
+
+			if (item.data && item.data.use_count() == 1)
+			{
+				item.data = NULL;
+				held--;
+			}
+		}
+
+		while (vec.size() > (size_t)(limit) && vec.back().data.get() == NULL) vec.pop_back();
+	}
+	// 按周期内同时使用的峰值调整容量(利特尔法则：同时使用的数量等于获取频率乘以平均占用时间)，
+	// 保留25%的余量；有调用方等待时立即扩容(调用时已持有锁)
+	void adjust(int64 now, int inuse, bool waiting)
+	{
+		if (minlen <= 0) return;
+
+		peak = max(peak, inuse);
+
+		if (waiting)
+		{
+			if (limit < maxlen && now - lastGrow >= 10)
+			{
+				limit++;
+				growCount++;
+				lastGrow = now;
+			}
+
+			return;
+		}
+
+		if (lastAdjust == 0) lastAdjust = now;
+
+		if (now - lastAdjust < interval) return;
+
+		int target = max(minlen, min(maxlen, (peak * 5 + 3) / 4));
+
+		if (target > limit)
+		{
+			limit = target;
+			growCount++;
+			lastGrow = now;
+		}
+		else if (target < limit && now - lastGrow >= interval)
+		{
+			limit = max(target, limit - max(1, (limit - target) / 2));	// 逐步缩容，避免突发流量后立即再次扩容
+			shrinkCount++;
+
+			trim();
+		}
+
+		peak = inuse;
+		lastAdjust = now;
+	}
+
+	// 优先级可以使用的容量，reserve部分只供HIGH使用
+	int getCap(int priority) const
+	{
+		return priority == HIGH ? limit : max(1, limit - reserve);
+	}
+	// 其它优先级中正在等待的最小虚拟时间，没有等待时返回-1。inuse大于等于0时忽略正在使用inuse个资源
+	// 的情况下容量已满的优先级，它们即使轮到也无法获取(调用时已持有锁)
+	int64 getMinVtime(int priority, int inuse = -1) const
+	{
+		int64 res = -1;
+
+		for (int i = 0; i < PRIORITY_COUNT; i++)
+		{
+			if (i == priority || waiters[i] <= 0 || (inuse >= 0 && inuse >= getCap(i))) continue;
+
+			if (res < 0 || vtimes[i] < res) res = vtimes[i];
+		}
+
+		return res;
+	}
+	// 加权公平调度：有其它优先级在等待时，虚拟时间最小的优先级先获取，只比较当前还能获取资源的优先级，
+	// 如预留的容量空闲时HIGH不会因为受容量限制的LOW正在等待而阻塞(调用时已持有锁)
+	bool isTurn(int priority, int inuse) const
+	{
+		int64 vtime = getMinVtime(priority, inuse);
+
+		return vtime < 0 || vtimes[priority] <= vtime;
+	}
+	// 存在竞争时推进虚拟时间(每次增加840/权重，840能被1到8整除)。之前空闲而落后过多的优先级
+	// 最多落后一个最大步长，只能领先一轮，不能积累额度(调用时已持有锁)
+	void served(int priority)
+	{
+		int64 vtime = getMinVtime(priority);
+
+		if (vtime < 0) return;
+
+		vtimes[priority] = max(vtimes[priority], vtime - 840) + max(840 / weights[priority], 1);
+	}
+
 public:
-	shared_ptr<T> get()
+	// priority为获取资源的优先级：容量中的reserve部分只有HIGH可以使用，容量已满时各优先级按权重轮流获取归还的资源，
+	// wait为容量已满时最多等待的毫秒数，小于等于0时不等待
+	shared_ptr<T> get(int priority = NORMAL, int wait = 3000)
 	{
 		if (timeout <= 0) return func();
 
+		bool failed = false;	// 创建资源失败(而不是资源已满)时不再等待重试
+		int64 start = 0;
+
+		priority = max((int)(HIGH), min(priority, (int)(LOW)));
+
+		// 获取成功(调用时已持有锁)
+		auto finish = [&](int64 clock, int inuse){
+			getCount++;
+			prioGetCount[priority]++;
+
+			if (start > 0)
+			{
+				waitTime += clock - start;
+				prioWaitTime[priority] += clock - start;
+				waiters[priority]--;
+				start = 0;
+			}
+
+			served(priority);
+			adjust(clock, inuse, false);
+		};
+
+		// 需要等待(调用时已持有锁)
+		auto block = [&](int64 clock, int inuse, bool full){
+			if (start == 0)
+			{
+				start = clock;
+				waitCount++;
+				prioWaitCount[priority]++;
+
+				if (waiters[priority]++ == 0) vtimes[priority] = max(vtimes[priority], getMinVtime(priority));
+			}
+
+			adjust(clock, inuse, full);
+
+			mtx.unlock();
+
+			return shared_ptr<T>();
+		};
+
 		auto grasp = [&](){
-			int len = 0;
-			int idx = -1;
+			int held = 0;
+			int inuse = 1 + pending;
 			shared_ptr<T> tmp;
 			time_t now = time(NULL);
+			int64 clock = GetClock();
 
 			mtx.lock();
 
-			len = vec.size();
+			if (vec.size() > (size_t)(limit)) trim();	// 缩容时正在使用的资源归还后再释放
+
+			for (size_t i = 0; i < vec.size(); i++)
+			{
+				if (vec[i].data && vec[i].data.use_count() > 1) inuse++;
+			}
+
+			int cap = getCap(priority);
 
-			for (int i = 0; i < len; i++)
+			if (inuse > cap || isTurn(priority, inuse - 1) == false) return block(clock, inuse - 1, inuse > cap);
+
+			for (size_t i = 0; i < vec.size(); i++)
 			{
 				Data& item = vec[i];
 
@@ -80,6 +290,8 @@ public:
 						{
 							shared_ptr<T> data = item.get();
 
+							finish(clock, inuse);
+
 							mtx.unlock();
 
 							return data;
@@ -87,37 +299,58 @@ public:
 
 						item.data = NULL;
 					}
-
-					idx = i;
 				}
+
+				if (item.data) held++;
 			}
 
-			mtx.unlock();
+			if (held + pending >= limit) return block(clock, inuse - 1, true);
 
-			if (idx < 0)
-			{
-				if (len >= maxlen) return shared_ptr<T>();
+			pending++;	// 解锁创建期间占用容量，并发的调用方不会超出上限
 
-				shared_ptr<T> data = func();
+			int64 gen = epoch;
 
-				if (data.get() == NULL) return data;
+			mtx.unlock();
 
-				mtx.lock();
+			shared_ptr<T> data = func();
 
-				if (vec.size() < maxlen) vec.push_back(data);
+			mtx.lock();
+
+			pending--;
+
+			if (data.get() == NULL)
+			{
+				failed = true;
 
 				mtx.unlock();
 
 				return data;
 			}
 
-			shared_ptr<T> data = func();
+			if (gen != epoch)	// 创建期间连接池被清空(如配置已经改变)，丢弃后重新获取
+			{
+				mtx.unlock();
 
-			if (data.get() == NULL) return data;
+				return shared_ptr<T>();
+			}
 
-			mtx.lock();
+			clock = GetClock();
+
+			auto it = find_if(vec.begin(), vec.end(), [](const Data& item){
+				return item.data.get() == NULL;
+			});
+
+			// 创建期间缩容时可能暂时超出容量，归还后由trim释放，资源始终由连接池管理
+			if (it == vec.end())
+			{
+				vec.push_back(data);
+			}
+			else
+			{
+				it->update(data);
+			}
 
-			vec[idx].update(data);
+			finish(clock, inuse);
 
 			mtx.unlock();
 
@@ -126,17 +359,24 @@ public:
 
 		shared_ptr<T> data = grasp();
 
-		if (data) return data;
+		if (data || failed) return data;
 
-		time_t endtime = time(NULL) + 3;
+		int64 endtime = GetClock() + wait;
 
-		while (true)
+		while (GetClock() < endtime)
 		{
-			Sleep(10);
+			Sleep(priority == HIGH ? 1 : 10);
 
 			if (data = grasp()) return data;
 
-			if (endtime < time(NULL)) break;
+			if (failed) break;
+		}
+
+		if (start > 0)
+		{
+			lock_guard<mutex> lk(mtx);
+
+			waiters[priority]--;
 		}
 
 		return data;
@@ -146,11 +386,72 @@ public:
 		lock_guard<mutex> lk(mtx);
 
 		vec.clear();
+		epoch++;
+	}
+	// 批量放入已经创建好的资源(如预热时并发建立的连接)，超出当前容量的资源被丢弃，返回放入的数量。
+	// gen为创建资源之前取得的getEpoch()，期间连接池被清空(如配置已经改变)时整批丢弃，小于0时不检查
+	int put(const vector<shared_ptr<T>>& list, int64 gen = -1)
+	{
+		int cnt = 0;
+		lock_guard<mutex> lk(mtx);
+		int held = pending;	// 正在创建的资源同样占用容量
+
+		if (gen >= 0 && gen != epoch) return 0;
+
+		for (Data& item : vec)
+		{
+			if (item.data) held++;
+		}
+
+		for (const shared_ptr<T>& data : list)
+		{
+			if (held >= limit) break;
+
+			auto it = find_if(vec.begin(), vec.end(), [](const Data& item){
+				return item.data.get() == NULL;
+			});
+
+			if (it == vec.end())
+			{
+				vec.push_back(data);
+			}
+			else
+			{
+				it->update(data);
+			}
+
+			held++;
+			cnt++;
+		}
+
+		return cnt;
+	}
+	int size()
+	{
+		int cnt = 0;
+		lock_guard<mutex> lk(mtx);
+
+		for (Data& item : vec)
+		{
+			if (item.data) cnt++;
+		}
+
+		return cnt;
 	}
 	int getLength() const
 	{
 		return maxlen;
 	}
+	// 连接池被清空的次数，不加锁读取，用于判断在此之前取得的资源是否已经过期
+	int64 getEpoch() const
+	{
+		return epoch;
+	}
+	// 当前容量(未开启自适应时等于getLength)
+	int getLimit() const
+	{
+		return limit;
+	}
 	int getTimeout() const
 	{
 		return timeout;
@@ -169,13 +470,78 @@ public:
 			}
 		}
 	}
+	// 设置固定容量(关闭自适应)，缩小时只释放超出部分的空闲资源
 	void setLength(int maxlen)
 	{
 		lock_guard<mutex> lk(mtx);
 
-		this->maxlen = maxlen;
+		this->minlen = 0;
+		this->limit = this->maxlen = max(maxlen, 1);
+
+		trim();
+	}
+	// 开启自适应：容量在minlen和maxlen之间，每interval毫秒按同时使用的峰值调整，容量已满需要等待时立即扩容
+	void setAdaptive(int minlen, int maxlen, int interval = 1000)
+	{
+		lock_guard<mutex> lk(mtx);
+
+		this->maxlen = max(maxlen, 1);
+		this->minlen = max(1, min(minlen, this->maxlen));
+		this->limit = max(this->minlen, min(this->limit, this->maxlen));
+		this->interval = max(interval, 10);
+		this->peak = 0;
+		this->lastAdjust = 0;
 
-		if (vec.size() > maxlen) vec.clear();
+		trim();
+	}
+	// 设置优先级调度：reserve为只有HIGH可以使用的容量，其余为各优先级在容量已满时轮流获取的权重
+	void setQos(int reserve, int high = 8, int normal = 4, int low = 1)
+	{
+		lock_guard<mutex> lk(mtx);
+
+		this->reserve = max(reserve, 0);
+
+		weights[HIGH] = max(high, 1);
+		weights[NORMAL] = max(normal, 1);
+		weights[LOW] = max(low, 1);
+	}
+	Stat getStat()
+	{
+		Stat stat;
+		lock_guard<mutex> lk(mtx);
+
+		stat.size = 0;
+		stat.inuse = 0;
+
+		for (Data& item : vec)
+		{
+			if (item.data.get() == NULL) continue;
+
+			if (item.data.use_count() > 1) stat.inuse++;
+
+			stat.size++;
+		}
+
+		stat.minlen = minlen > 0 ? minlen : maxlen;
+		stat.maxlen = maxlen;
+		stat.limit = limit;
+		stat.peak = peak;
+		stat.getCount = getCount;
+		stat.waitCount = waitCount;
+		stat.waitTime = waitTime;
+		stat.growCount = growCount;
+		stat.shrinkCount = shrinkCount;
+		stat.reserve = reserve;
+
+		for (int i = 0; i < PRIORITY_COUNT; i++)
+		{
+			stat.weights[i] = weights[i];
+			stat.prioGetCount[i] = prioGetCount[i];
+			stat.prioWaitCount[i] = prioWaitCount[i];
+			stat.prioWaitTime[i] = prioWaitTime[i];
+		}
+
+		return stat;
 	}
 	void setTimeout(int timeout)
 	{
@@ -195,14 +561,19 @@ public:
 	ResPool(int maxlen = 8, int timeout = 60)
 	{
 		this->timeout = timeout;
-		this->maxlen = maxlen;
+		this->limit = this->maxlen = maxlen;
 	}
 	ResPool(function<shared_ptr<T>()> func, int maxlen = 8, int timeout = 60)
 	{
 		this->timeout = timeout;
-		this->maxlen = maxlen;
+		this->limit = this->maxlen = maxlen;
 		this->func = func;
 	}
 };
+
+template<typename T> const int ResPool<T>::HIGH;
+template<typename T> const int ResPool<T>::NORMAL;
+template<typename T> const int ResPool<T>::LOW;
+template<typename T> const int ResPool<T>::PRIORITY_COUNT;
 //////////////////////////////////////////////////////////////////////////////
 #endif
\ No newline at end of file